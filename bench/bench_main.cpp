@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "companion/bitboard_engine.h"
+#include "companion/fixpoint_engine.h"
+#include "companion/entailment_solver.h"
+#include "companion/probability_engine.h"
+#include "companion/monte_carlo.h"
+#include "companion/belief_propagation.h"
+#include "companion/dragon_tracker.h"
+
+// Headless benchmarks for the inference engines.
+//
+// propagation: plays random games on a 10x10 board and reports how many
+// sweeps and rule firings the fixpoint engine needs per observation.
+// solver: same games, time the entailment solver takes per observation.
+// probability: same games, exact hazard probabilities per observation.
+// montecarlo: fewer games, sampled probabilities against the exact ones.
+// dragon: same games, how soon the classic rules and the candidate
+// tracker pin the dragon down.
+// belief: fewer games, belief propagation against the exact probabilities,
+// then sweep cost and accuracy on a large board with wrong observations.
+
+constexpr int32 bench_size = 10;
+constexpr int32 bench_games = 20000;
+constexpr int32 bench_sampled_games = 100;
+constexpr int32 bench_large_size = 1024;
+constexpr float bench_error_rate = 0.05f;
+constexpr int32 bench_hazard_counts[a__Count]{ 8, 4, 1 };
+constexpr std::chrono::microseconds bench_budget{ 1000 };
+constexpr BoardGeometry bench_geometry(Torus{}, bench_size, bench_size);
+
+//////////////////////////////
+// BenchGame
+//////////////////////////////
+
+struct BenchGame
+{
+    BoardMasks m_masks;
+    Bitboard m_hazards[a__Count];
+};
+
+void place_hazards(
+    BenchGame& game,
+    const BoardGeometry& geometry,
+    std::mt19937& rng)
+{
+    std::uniform_int_distribution<int32> room_dist(0, geometry.room_count() - 1);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        while (game.m_hazards[a].count() < bench_hazard_counts[a])
+        {
+            game.m_hazards[a].set(room_dist(rng));
+        }
+    }
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        game.m_masks.m_neighbor_state[a][ns_Unknown] = geometry.all();
+        game.m_masks.m_room_state[a][rs_Unknown] = geometry.all();
+        game.m_masks.m_hazard_count[a] = bench_hazard_counts[a];
+    }
+}
+
+void observe(
+    BenchGame& game,
+    const BoardGeometry& geometry,
+    const int32 index)
+{
+    Bitboard room;
+    room.set(index);
+    Bitboard neighbors = geometry.neighbors_of(room);
+
+    game.m_masks.m_visited |= room;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        Bitboard* room_state = game.m_masks.m_room_state[a];
+        Bitboard* neighbor_state = game.m_masks.m_neighbor_state[a];
+        if (!(room_state[rs_Yes] & room).any())
+        {
+            for (int32 state = 0; state < rs__Count; state++)
+            {
+                room_state[state] &= ~room;
+            }
+            room_state[rs_No] |= room;
+        }
+
+        NeighborState warning = (game.m_hazards[a] & neighbors).any() ? ns_Yes : ns_No;
+        for (int32 state = 0; state < ns__Count; state++)
+        {
+            neighbor_state[state] &= ~room;
+        }
+        neighbor_state[warning] |= room;
+    }
+}
+
+// Visits safe rooms of random games in random order and calls
+// on_observation(game) after each one.
+template<typename OnObservation>
+void play_bench_games(
+    const BoardGeometry& geometry,
+    OnObservation&& on_observation,
+    const int32 game_count = bench_games)
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int32> room_dist(0, geometry.room_count() - 1);
+
+    for (int32 game_index = 0; game_index < game_count; game_index++)
+    {
+        BenchGame game;
+        place_hazards(game, geometry, rng);
+
+        Bitboard hazards = game.m_hazards[a_Pit] | game.m_hazards[a_Arrow] | game.m_hazards[a_Dragon];
+        for (int32 step = 0; step < geometry.room_count(); step++)
+        {
+            int32 index = room_dist(rng);
+            if (hazards.test(index) || game.m_masks.m_visited.test(index))
+                continue;
+
+            observe(game, geometry, index);
+            on_observation(game);
+        }
+    }
+}
+
+//////////////////////////////
+// Benchmarks
+//////////////////////////////
+
+void bench_propagation()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    FixpointEngine fixpoint_engine(bench_geometry);
+
+    int64 observations = 0;
+    int64 sweeps = 0;
+    int64 max_sweeps = 0;
+    int64 firings[fr__Count]{};
+    int64 budget_exhausted = 0;
+    std::chrono::nanoseconds elapsed{ 0 };
+
+    play_bench_games(bitboard_engine.get_geometry(), [&](BenchGame& game)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bitboard_engine.update_room_states(game.m_masks);
+        FixpointStats stats = fixpoint_engine.run(game.m_masks, bench_budget);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        observations++;
+        sweeps += stats.m_sweeps;
+        max_sweeps = std::max<int64>(max_sweeps, stats.m_sweeps);
+        budget_exhausted += stats.m_budget_exhausted;
+        for (int32 rule = 0; rule < fr__Count; rule++)
+        {
+            firings[rule] += stats.m_rule_firings[rule];
+        }
+    });
+
+    const char* rule_labels[fr__Count]{ "no", "unit", "subset", "count" };
+
+    printf("propagation: %lld observations over %d games\n", (long long)observations, bench_games);
+    printf("  sweeps/observation    %8.3f (max %lld)\n", double(sweeps) / observations, (long long)max_sweeps);
+    for (int32 rule = 0; rule < fr__Count; rule++)
+    {
+        printf("  %-6s firings/obs.   %8.3f\n", rule_labels[rule], double(firings[rule]) / observations);
+    }
+    printf("  budget exhausted      %8lld\n", (long long)budget_exhausted);
+    printf("  ns/observation        %8.1f\n", double(elapsed.count()) / observations);
+}
+
+void bench_solver()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    FixpointEngine fixpoint_engine(bench_geometry);
+    EntailmentSolver solver(bench_geometry);
+
+    int64 observations = 0;
+    int64 searches = 0;
+    int64 decisions = 0;
+    int64 gave_up = 0;
+    std::chrono::nanoseconds elapsed{ 0 };
+    std::chrono::nanoseconds max_elapsed{ 0 };
+
+    play_bench_games(bitboard_engine.get_geometry(), [&](BenchGame& game)
+    {
+        bitboard_engine.update_room_states(game.m_masks);
+        fixpoint_engine.run(game.m_masks, bench_budget);
+
+        auto start = std::chrono::steady_clock::now();
+        SolverStats stats = solver.run(game.m_masks);
+        std::chrono::nanoseconds solve_time = std::chrono::steady_clock::now() - start;
+        elapsed += solve_time;
+        max_elapsed = std::max(max_elapsed, solve_time);
+
+        observations++;
+        searches += stats.m_searches;
+        decisions += stats.m_decisions;
+        gave_up += std::count(std::begin(stats.m_gave_up), std::end(stats.m_gave_up), true);
+    });
+
+    printf("solver: %lld observations over %d games\n", (long long)observations, bench_games);
+    printf("  searches/observation  %8.3f\n", double(searches) / observations);
+    printf("  decisions/observation %8.3f\n", double(decisions) / observations);
+    printf("  attributes given up   %8lld\n", (long long)gave_up);
+    printf("  ns/observation        %8.1f (max %lld)\n", double(elapsed.count()) / observations, (long long)max_elapsed.count());
+}
+
+void bench_probability()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    FixpointEngine fixpoint_engine(bench_geometry);
+    EntailmentSolver solver(bench_geometry);
+    ProbabilityEngine probability_engine;
+
+    int64 observations = 0;
+    int64 nodes = 0;
+    int64 cache_hits = 0;
+    int32 largest_component = 0;
+    std::chrono::nanoseconds elapsed{ 0 };
+    std::chrono::nanoseconds max_elapsed{ 0 };
+
+    play_bench_games(bitboard_engine.get_geometry(), [&](BenchGame& game)
+    {
+        bitboard_engine.update_room_states(game.m_masks);
+        fixpoint_engine.run(game.m_masks, bench_budget);
+        solver.run(game.m_masks);
+
+        auto start = std::chrono::steady_clock::now();
+        ProbabilityStats stats;
+        float probabilities[bitboard_capacity];
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            HazardProblem problem = solver.make_problem(game.m_masks, (Attribute)a);
+            probability_engine.compute(problem, probabilities, stats);
+        }
+        std::chrono::nanoseconds compute_time = std::chrono::steady_clock::now() - start;
+        elapsed += compute_time;
+        max_elapsed = std::max(max_elapsed, compute_time);
+
+        observations++;
+        nodes += stats.m_nodes;
+        cache_hits += stats.m_cache_hits;
+        largest_component = std::max(largest_component, stats.m_largest_component);
+    });
+
+    printf("probability: %lld observations over %d games\n", (long long)observations, bench_games);
+    printf("  nodes/observation     %8.3f\n", double(nodes) / observations);
+    printf("  cache hits/obs.       %8.3f\n", double(cache_hits) / observations);
+    printf("  largest component     %8d\n", largest_component);
+    printf("  ns/observation        %8.1f (max %lld)\n", double(elapsed.count()) / observations, (long long)max_elapsed.count());
+}
+
+void bench_montecarlo()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    FixpointEngine fixpoint_engine(bench_geometry);
+    EntailmentSolver solver(bench_geometry);
+    ProbabilityEngine probability_engine;
+    MonteCarloEstimator estimator;
+    MonteCarloSettings settings;
+
+    int64 estimates = 0;
+    int64 converged = 0;
+    int64 samples = 0;
+    int64 rooms = 0;
+    int64 outside = 0;
+    double max_error = 0.0;
+    std::chrono::nanoseconds elapsed{ 0 };
+
+    play_bench_games(bitboard_engine.get_geometry(), [&](BenchGame& game)
+    {
+        bitboard_engine.update_room_states(game.m_masks);
+        fixpoint_engine.run(game.m_masks, bench_budget);
+        solver.run(game.m_masks);
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            HazardProblem problem = solver.make_problem(game.m_masks, (Attribute)a);
+            ProbabilityStats stats;
+            float exact[bitboard_capacity];
+            if (!probability_engine.compute(problem, exact, stats))
+                continue;
+
+            auto start = std::chrono::steady_clock::now();
+            MonteCarloResult result = estimator.estimate(problem, settings);
+            elapsed += std::chrono::steady_clock::now() - start;
+
+            estimates++;
+            converged += result.m_converged;
+            samples += result.m_samples;
+
+            Bitboard open = problem.m_open;
+            while (open.any())
+            {
+                int32 index = open.first();
+                open.reset(index);
+
+                double error = std::abs(result.m_probability[index] - exact[index]);
+                rooms++;
+                outside += error > result.m_half_width[index];
+                if (result.m_converged)
+                    max_error = std::max(max_error, error);
+            }
+        }
+    }, bench_sampled_games);
+
+    printf("montecarlo: %lld estimates over %d games, %d threads\n", (long long)estimates, bench_sampled_games, estimator.get_thread_count());
+    printf("  converged             %8.3f\n", double(converged) / estimates);
+    printf("  samples/estimate      %8.1f\n", double(samples) / estimates);
+    printf("  outside interval      %8.3f\n", double(outside) / rooms);
+    printf("  max error (converged) %8.3f\n", max_error);
+    printf("  us/estimate           %8.1f\n", double(elapsed.count()) / estimates / 1000.0);
+}
+
+void bench_dragon()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    const BoardGeometry& geometry = bitboard_engine.get_geometry();
+    DragonTracker tracker(bench_geometry);
+
+    // The same game again, with the tracker applied after each observation.
+    BenchGame tracked;
+
+    int64 observations = 0;
+    int64 classic_found = 0;
+    int64 tracker_found = 0;
+    int64 classic_steps = 0;
+    int64 tracker_steps = 0;
+    std::chrono::nanoseconds elapsed{ 0 };
+
+    play_bench_games(geometry, [&](BenchGame& game)
+    {
+        Bitboard room = game.m_masks.m_visited;
+        if (room.count() == 1)
+        {
+            tracked = game;
+            tracked.m_masks.m_visited = {};
+            tracker.reset();
+        }
+        room &= ~tracked.m_masks.m_visited;
+
+        int32 index = room.first();
+        observations++;
+
+        bool classic_known = game.m_masks.m_room_state[a_Dragon][rs_Yes].any();
+        bitboard_engine.update_room_states(game.m_masks);
+        if (!classic_known && game.m_masks.m_room_state[a_Dragon][rs_Yes].any())
+        {
+            classic_found++;
+            classic_steps += game.m_masks.m_visited.count();
+        }
+
+        bool tracker_known = tracked.m_masks.m_room_state[a_Dragon][rs_Yes].any();
+        observe(tracked, geometry, index);
+
+        auto start = std::chrono::steady_clock::now();
+        tracker.observe(index, tracked.m_masks.m_neighbor_state[a_Dragon][ns_Yes].test(index) ? ns_Yes : ns_No);
+        bitboard_engine.update_room_states(tracked.m_masks);
+        if (tracker.apply(tracked.m_masks))
+            update_maybe_states(tracked.m_masks, geometry, a_Dragon);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        if (!tracker_known && tracked.m_masks.m_room_state[a_Dragon][rs_Yes].any())
+        {
+            tracker_found++;
+            tracker_steps += tracked.m_masks.m_visited.count();
+        }
+    });
+
+    printf("dragon: %lld observations over %d games\n", (long long)observations, bench_games);
+    printf("  found, classic        %8.3f after %6.2f observations\n", double(classic_found) / bench_games, double(classic_steps) / std::max<int64>(classic_found, 1));
+    printf("  found, tracker        %8.3f after %6.2f observations\n", double(tracker_found) / bench_games, double(tracker_steps) / std::max<int64>(tracker_found, 1));
+    printf("  ns/observation        %8.1f\n", double(elapsed.count()) / observations);
+}
+
+void bench_belief()
+{
+    BitboardEngine bitboard_engine(bench_geometry);
+    EntailmentSolver solver(bench_geometry);
+    ProbabilityEngine probability_engine;
+    std::vector<BeliefPropagation<Torus>> belief_engines(a__Count, BeliefPropagation<Torus>(bench_size, bench_size));
+    BeliefSettings settings;
+    settings.m_error_rate = 0.01f;
+
+    int64 rooms = 0;
+    int64 sweeps = 0;
+    int64 runs = 0;
+    double total_error = 0.0;
+
+    // Without a known total, exact counting weighs all placements of pits
+    // and arrows alike, which is a prior of 1/2. The single dragon has no
+    // such prior and is left out.
+    settings.m_prior = 0.5f;
+
+    play_bench_games(bitboard_engine.get_geometry(), [&](BenchGame& game)
+    {
+        if (game.m_masks.m_visited.count() == 1)
+        {
+            for (BeliefPropagation<Torus>& engine : belief_engines)
+            {
+                engine.reset();
+            }
+        }
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            if (is_hazard_unique((Attribute)a))
+                continue;
+
+            BoardMasks masks = game.m_masks;
+            masks.m_hazard_count[a] = -1;
+            HazardProblem problem = solver.make_problem(masks, (Attribute)a);
+            ProbabilityStats stats;
+            float exact[bitboard_capacity];
+            if (!probability_engine.compute(problem, exact, stats))
+                continue;
+
+            BeliefPropagation<Torus>& engine = belief_engines[a];
+            for (int32 index = 0; index < bench_size * bench_size; index++)
+            {
+                bool visited = game.m_masks.m_visited.test(index);
+                NeighborState warning = game.m_masks.m_neighbor_state[a][ns_Yes].test(index) ? ns_Yes : ns_No;
+                engine.set_warning(index, visited ? warning : ns_Unknown);
+                engine.set_room_evidence(index, visited ? rs_No : rs_Unknown);
+            }
+
+            sweeps += engine.run(settings).m_sweeps;
+            runs++;
+
+            Bitboard open = problem.m_open;
+            while (open.any())
+            {
+                int32 index = open.first();
+                open.reset(index);
+                total_error += std::abs(engine.get_belief(index) - exact[index]);
+                rooms++;
+            }
+        }
+    }, bench_sampled_games);
+
+    printf("belief: %lld runs over %d games\n", (long long)runs, bench_sampled_games);
+    printf("  sweeps/run            %8.3f\n", double(sweeps) / runs);
+    printf("  mean error vs. exact  %8.3f\n", total_error / rooms);
+
+    // Large board, every other room visited, some warnings entered wrong.
+    constexpr int32 room_count = bench_large_size * bench_large_size;
+    std::mt19937 rng(1);
+    std::bernoulli_distribution is_hazard(0.1);
+    std::bernoulli_distribution is_wrong(bench_error_rate);
+
+    std::vector<bool> hazards(room_count);
+    for (int32 index = 0; index < room_count; index++)
+    {
+        hazards[index] = is_hazard(rng);
+    }
+
+    BeliefPropagation<Torus> engine(bench_large_size, bench_large_size);
+    int32 wrong = 0;
+    for (int32 y = 0; y < bench_large_size; y++)
+    {
+        for (int32 x = (y & 1); x < bench_large_size; x += 2)
+        {
+            int32 index = y * bench_large_size + x;
+            if (hazards[index])
+                continue;
+
+            auto wrap = [](const int32 value) { return (value + bench_large_size) % bench_large_size; };
+            bool warning =
+                hazards[y * bench_large_size + wrap(x - 1)] ||
+                hazards[y * bench_large_size + wrap(x + 1)] ||
+                hazards[wrap(y - 1) * bench_large_size + x] ||
+                hazards[wrap(y + 1) * bench_large_size + x];
+
+            if (is_wrong(rng))
+            {
+                warning = !warning;
+                wrong++;
+            }
+
+            engine.set_warning(index, warning ? ns_Yes : ns_No);
+            engine.set_room_evidence(index, rs_No);
+        }
+    }
+
+    BeliefSettings large_settings;
+    large_settings.m_error_rate = bench_error_rate;
+
+    auto start = std::chrono::steady_clock::now();
+    BeliefStats stats = engine.run(large_settings);
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+    // Unvisited rooms only, the others are known to be empty.
+    double hazard_belief = 0.0;
+    double empty_belief = 0.0;
+    int64 hazard_rooms = 0;
+    for (int32 y = 0; y < bench_large_size; y++)
+    {
+        for (int32 x = 1 - (y & 1); x < bench_large_size; x += 2)
+        {
+            int32 index = y * bench_large_size + x;
+            (hazards[index] ? hazard_belief : empty_belief) += engine.get_belief(index);
+            hazard_rooms += hazards[index];
+        }
+    }
+
+    printf("  large board           %dx%d, %d wrong warnings\n", bench_large_size, bench_large_size, wrong);
+    printf("  sweeps                %8d (converged %d)\n", stats.m_sweeps, (int32)stats.m_converged);
+    printf("  ms/sweep              %8.3f\n", double(elapsed.count()) / stats.m_sweeps / 1e6);
+    printf("  belief, hazards       %8.3f\n", hazard_belief / hazard_rooms);
+    printf("  belief, empty rooms   %8.3f\n", empty_belief / (room_count / 2 - hazard_rooms));
+}
+
+//////////////////////////////
+// Main entry point
+//////////////////////////////
+
+int main()
+{
+    bench_propagation();
+    bench_solver();
+    bench_probability();
+    bench_dragon();
+    bench_montecarlo();
+    bench_belief();
+    return 0;
+}
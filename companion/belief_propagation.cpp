@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cmath>
+#include "belief_propagation.h"
+
+float get_odds(
+    const float probability)
+{
+    return probability / (1.f - probability);
+}
+
+template <typename Topology>
+BeliefPropagation<Topology>::BeliefPropagation(
+    const int32 width,
+    const int32 height) :
+    m_width(width),
+    m_height(height)
+{
+    reset();
+}
+
+template <typename Topology>
+void BeliefPropagation<Topology>::reset()
+{
+    // The wall slot never gets a warning, so its messages stay neutral
+    // and its odds keep saying it is empty.
+    int32 room_count = get_room_count();
+    m_warnings.assign(room_count, ns_Unknown);
+    m_room_evidence.assign(room_count, rs_Unknown);
+    m_messages.assign((room_count + wall_count) * direction_count, 1.f);
+    m_odds.assign(room_count + wall_count, 0.f);
+    std::fill_n(m_odds.begin(), room_count, 1.f);
+}
+
+template <typename Topology>
+void BeliefPropagation<Topology>::set_warning(
+    const int32 index,
+    const NeighborState warning)
+{
+    if (m_warnings[index] == warning)
+        return;
+
+    m_warnings[index] = (uint8)warning;
+    if (warning == ns_Unknown)
+    {
+        std::fill_n(m_messages.begin() + index * direction_count, direction_count, 1.f);
+    }
+}
+
+template <typename Topology>
+void BeliefPropagation<Topology>::set_room_evidence(
+    const int32 index,
+    const RoomState evidence)
+{
+    m_room_evidence[index] = (uint8)evidence;
+}
+
+template <typename Topology>
+BeliefStats BeliefPropagation<Topology>::run(
+    const BeliefSettings& settings)
+{
+    BeliefStats stats;
+    while (stats.m_sweeps < settings.m_max_sweeps)
+    {
+        stats.m_sweeps++;
+        stats.m_max_change = sweep(settings);
+        if (stats.m_max_change < settings.m_tolerance)
+        {
+            stats.m_converged = true;
+            break;
+        }
+    }
+
+    update_odds(settings);
+    return stats;
+}
+
+template <typename Topology>
+float BeliefPropagation<Topology>::get_belief(
+    const int32 index) const
+{
+    return m_odds[index] / (1.f + m_odds[index]);
+}
+
+template <typename Topology>
+void BeliefPropagation<Topology>::update_odds(
+    const BeliefSettings& settings)
+{
+    float prior = get_odds(settings.m_prior);
+    float evidence = get_odds(1.f - settings.m_error_rate);
+
+    for (int32 y = 0; y < m_height; y++)
+    {
+        for (int32 x = 0; x < m_width; x++)
+        {
+            int32 index = y * m_width + x;
+            float odds = prior;
+            if (m_room_evidence[index] == rs_No)
+                odds /= evidence;
+            else if (m_room_evidence[index] == rs_Yes)
+                odds *= evidence;
+
+            auto neighbors = get_neighbors(x, y);
+            for (int32 direction = 0; direction < direction_count; direction++)
+            {
+                odds *= m_messages[neighbors[direction] * direction_count + (direction ^ 1)];
+            }
+
+            m_odds[index] = odds;
+        }
+    }
+}
+
+template <typename Topology>
+float BeliefPropagation<Topology>::sweep(
+    const BeliefSettings& settings)
+{
+    update_odds(settings);
+
+    // Chance of the observed warning when some neighbor holds the hazard
+    // and when none does.
+    float error = settings.m_error_rate;
+    float max_change = 0.f;
+
+    for (int32 y = 0; y < m_height; y++)
+    {
+        for (int32 x = 0; x < m_width; x++)
+        {
+            int32 index = y * m_width + x;
+            if (m_warnings[index] == ns_Unknown)
+                continue;
+
+            float if_any = m_warnings[index] == ns_Yes ? 1.f - error : error;
+            float if_none = 1.f - if_any;
+            float* messages = &m_messages[index * direction_count];
+
+            // Chance that each neighbor is empty, leaving out what this
+            // warning told it.
+            auto neighbors = get_neighbors(x, y);
+
+            float empty[direction_count];
+            for (int32 direction = 0; direction < direction_count; direction++)
+            {
+                float message = messages[direction];
+                empty[direction] = message / (message + m_odds[neighbors[direction]]);
+            }
+
+            for (int32 direction = 0; direction < direction_count; direction++)
+            {
+                float others_empty = 1.f;
+                for (int32 other = 0; other < direction_count; other++)
+                {
+                    if (other != direction)
+                        others_empty *= empty[other];
+                }
+
+                // The neighbor holding the hazard explains the warning by
+                // itself, otherwise one of the others has to.
+                float message = if_any / (if_any * (1.f - others_empty) + if_none * others_empty);
+                message = settings.m_damping * messages[direction] + (1.f - settings.m_damping) * message;
+
+                max_change = std::max(max_change, std::abs(message - messages[direction]) / messages[direction]);
+                messages[direction] = message;
+            }
+        }
+    }
+
+    return max_change;
+}
+
+template class BeliefPropagation<Torus>;
+template class BeliefPropagation<WalledGrid>;
+template class BeliefPropagation<HexGrid>;
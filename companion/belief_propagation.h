@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include "dungeon_types.h"
+#include "topology.h"
+
+//////////////////////////////
+// BeliefSettings
+//////////////////////////////
+
+struct BeliefSettings
+{
+    float m_prior = 0.1f;                   // hazard chance of a room before any observation
+    float m_error_rate = 0.05f;             // chance that an observation was entered wrong
+    float m_damping = 0.5f;                 // share of the old message kept per sweep
+    float m_tolerance = 1e-2f;              // largest relative message change to stop at
+    int32 m_max_sweeps = 100;
+};
+
+//////////////////////////////
+// BeliefStats
+//////////////////////////////
+
+struct BeliefStats
+{
+    int32 m_sweeps = 0;
+    float m_max_change = 0.f;
+    bool m_converged = false;
+};
+
+//////////////////////////////
+// BeliefPropagation class
+//////////////////////////////
+
+// Approximate hazard marginals for one attribute by loopy belief
+// propagation, for boards of any size where exact counting is out of
+// reach.
+//
+// Every room has a hazard variable with the prior as its chance. A
+// visited room says it holds no hazard (or, after falling in, that it
+// does) and its warning says whether any of its neighbors does.
+// Both are trusted only up to the error rate, so one mistyped observation
+// bends the beliefs around it instead of contradicting the rest.
+//
+// Messages are odds ratios, one per warning and neighbor, so a sweep needs
+// no exp or log. They survive between runs and a new observation starts
+// from the previous fixpoint. A sweep updates every message once,
+// O(rooms). Neighbors come from the Topology, a torus must be at least
+// 3x3. A neighbor behind a wall is an extra room that is surely empty.
+template <typename Topology>
+class BeliefPropagation
+{
+public:
+    BeliefPropagation(
+        const int32 width,
+        const int32 height);
+
+    void reset();
+
+    // ns_Unknown when the room's warning was not observed.
+    void set_warning(
+        const int32 index,
+        const NeighborState warning);
+
+    // rs_No for a room visited safely, rs_Yes for one that holds the
+    // hazard, rs_Unknown otherwise.
+    void set_room_evidence(
+        const int32 index,
+        const RoomState evidence);
+
+    BeliefStats run(
+        const BeliefSettings& settings);
+
+    float get_belief(
+        const int32 index) const;
+
+    int32 get_room_count() const { return m_width * m_height; }
+
+private:
+    static constexpr int32 direction_count = Topology::direction_count;
+    static constexpr int32 wall_count = Topology::has_walls ? 1 : 0;
+
+    int32 m_width;
+    int32 m_height;
+    std::vector<uint8> m_warnings;          // NeighborState per room
+    std::vector<uint8> m_room_evidence;     // RoomState per room
+    std::vector<float> m_messages;          // warning to neighbor, direction_count per room
+    std::vector<float> m_odds;              // belief per room, 0 behind a wall
+
+    std::array<int32, direction_count> get_neighbors(
+        const int32 x,
+        const int32 y) const { return Topology::get_neighbors(x, y, m_width, m_height); }
+
+    void update_odds(
+        const BeliefSettings& settings);
+
+    float sweep(
+        const BeliefSettings& settings);
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include "dungeon_types.h"
+#include "topology.h"
+
+//////////////////////////////
+// Bitboard
+//////////////////////////////
+
+// One bit per room, indexed by y * width + x. Two words cover the
+// 10x10 handheld board with room to spare.
+constexpr int32 bitboard_capacity = 128;
+
+struct Bitboard
+{
+    uint64 m_words[2]{ 0, 0 };
+
+    constexpr bool test(
+        const int32 index) const
+    {
+        return ((m_words[index >> 6] >> (index & 63)) & 1) != 0;
+    }
+
+    constexpr void set(
+        const int32 index)
+    {
+        m_words[index >> 6] |= uint64(1) << (index & 63);
+    }
+
+    constexpr void reset(
+        const int32 index)
+    {
+        m_words[index >> 6] &= ~(uint64(1) << (index & 63));
+    }
+
+    constexpr bool any() const
+    {
+        return (m_words[0] | m_words[1]) != 0;
+    }
+
+    constexpr int32 count() const
+    {
+        return std::popcount(m_words[0]) + std::popcount(m_words[1]);
+    }
+
+    // Index of the lowest set bit, the bitboard must not be empty.
+    constexpr int32 first() const
+    {
+        return m_words[0] != 0 ?
+            std::countr_zero(m_words[0]) :
+            64 + std::countr_zero(m_words[1]);
+    }
+
+    constexpr Bitboard operator& (
+        const Bitboard& other) const
+    {
+        return { { m_words[0] & other.m_words[0], m_words[1] & other.m_words[1] } };
+    }
+
+    constexpr Bitboard operator| (
+        const Bitboard& other) const
+    {
+        return { { m_words[0] | other.m_words[0], m_words[1] | other.m_words[1] } };
+    }
+
+    constexpr Bitboard operator^ (
+        const Bitboard& other) const
+    {
+        return { { m_words[0] ^ other.m_words[0], m_words[1] ^ other.m_words[1] } };
+    }
+
+    // Not masked to the board, combine with BoardGeometry::all().
+    constexpr Bitboard operator~ () const
+    {
+        return { { ~m_words[0], ~m_words[1] } };
+    }
+
+    constexpr Bitboard& operator&= (
+        const Bitboard& other)
+    {
+        return *this = *this & other;
+    }
+
+    constexpr Bitboard& operator|= (
+        const Bitboard& other)
+    {
+        return *this = *this | other;
+    }
+
+    constexpr bool operator== (
+        const Bitboard& other) const = default;
+
+    constexpr Bitboard operator<< (
+        const int32 shift) const
+    {
+        if (shift == 0)
+            return *this;
+        if (shift >= 64)
+            return { { 0, m_words[0] << (shift - 64) } };
+        return { { m_words[0] << shift, (m_words[1] << shift) | (m_words[0] >> (64 - shift)) } };
+    }
+
+    constexpr Bitboard operator>> (
+        const int32 shift) const
+    {
+        if (shift == 0)
+            return *this;
+        if (shift >= 64)
+            return { { m_words[1] >> (shift - 64), 0 } };
+        return { { (m_words[0] >> shift) | (m_words[1] << (64 - shift)), m_words[1] >> shift } };
+    }
+
+    // Bit i takes bit (i + shift) % 128, for any shift and without
+    // branches.
+    constexpr Bitboard rotate(
+        const int32 shift) const
+    {
+        bool swap = (shift & 64) != 0;
+        uint64 low = swap ? m_words[1] : m_words[0];
+        uint64 high = swap ? m_words[0] : m_words[1];
+        int32 bits = shift & 63;
+
+        // Two steps so that a rotation by 0 shifts by at most 63.
+        return { {
+            (low >> bits) | ((high << 1) << (63 - bits)),
+            (high >> bits) | ((low << 1) << (63 - bits)) } };
+    }
+};
+
+//////////////////////////////
+// BoardGeometry
+//////////////////////////////
+
+// Whether a board sized at run time fits in a Bitboard. Everything built
+// on a BoardGeometry takes only boards that do.
+constexpr bool fits_bitboard(
+    const int32 width,
+    const int32 height)
+{
+    return width * height <= bitboard_capacity;
+}
+
+// Neighbor shifts over a width x height board that fits in a Bitboard,
+// built once from a topology. In each direction the rooms fall into at
+// most two groups whose neighbors sit at the same index offset (the
+// rooms along a wrapping edge, or the odd rows of a hex board), so
+// moving a whole board one step is two shifts and two masks whatever
+// the topology. Rooms with a wall that way get no bit.
+class BoardGeometry
+{
+public:
+    template <typename Topology>
+    constexpr BoardGeometry(
+        const Topology&,
+        const int32 width,
+        const int32 height) :
+        m_width(width),
+        m_height(height),
+        m_room_count(width * height),
+        m_direction_count(Topology::direction_count)
+    {
+        assert(fits_bitboard(width, height));
+
+        for (int32 index = 0; index < m_room_count; index++)
+        {
+            m_all.set(index);
+
+            auto neighbors = Topology::get_neighbors(index % width, index / width, width, height);
+            for (int32 d = 0; d < m_direction_count; d++)
+            {
+                if (neighbors[d] == m_room_count)
+                    continue;
+
+                int32 offset = neighbors[d] - index;
+                Shift* shift = m_shifts[d];
+                while (shift->m_rooms.any() && shift->m_offset != offset)
+                {
+                    shift++;
+
+                    // A topology with a third offset in one direction
+                    // has no group left for it.
+                    assert(shift < m_shifts[d] + 2);
+                }
+
+                shift->m_offset = offset;
+                shift->m_rooms.set(index);
+            }
+        }
+    }
+
+    constexpr int32 width() const { return m_width; }
+    constexpr int32 height() const { return m_height; }
+    constexpr int32 room_count() const { return m_room_count; }
+    constexpr int32 direction_count() const { return m_direction_count; }
+    constexpr const Bitboard& all() const { return m_all; }
+
+    // Every room takes the bit of its neighbor in the given direction.
+    // The bits a rotation wraps around land outside the masks.
+    constexpr Bitboard from(
+        const int32 direction,
+        const Bitboard& board) const
+    {
+        const Shift* shift = m_shifts[direction];
+        return
+            (board.rotate(shift[0].m_offset) & shift[0].m_rooms) |
+            (board.rotate(shift[1].m_offset) & shift[1].m_rooms);
+    }
+
+    // Rooms with at least one neighbor in the board.
+    constexpr Bitboard neighbors_of(
+        const Bitboard& board) const
+    {
+        Bitboard neighbors;
+        for (int32 d = 0; d < m_direction_count; d++)
+        {
+            neighbors |= from(d, board);
+        }
+        return neighbors;
+    }
+
+    // The two groups from() shifts a direction in, for engines that move
+    // boards of their own.
+    constexpr int32 get_shift_offset(
+        const int32 direction,
+        const int32 group) const { return m_shifts[direction][group].m_offset; }
+    constexpr const Bitboard& get_shift_rooms(
+        const int32 direction,
+        const int32 group) const { return m_shifts[direction][group].m_rooms; }
+
+    // The room count when there is a wall that way.
+    constexpr int32 get_neighbor(
+        const int32 index,
+        const int32 direction) const
+    {
+        for (const Shift& shift : m_shifts[direction])
+        {
+            if (shift.m_rooms.test(index))
+                return index + shift.m_offset;
+        }
+        return m_room_count;
+    }
+
+private:
+    struct Shift
+    {
+        int32 m_offset = 0;     // from a room to its neighbor
+        Bitboard m_rooms;       // rooms whose neighbor is that far
+    };
+
+    int32 m_width;
+    int32 m_height;
+    int32 m_room_count;
+    int32 m_direction_count;
+    Bitboard m_all;
+    Shift m_shifts[max_direction_count][2];
+};
+
+// The board's geometry when it fits in a Bitboard, otherwise one without
+// rooms, so that nothing built on it touches a bit.
+template <typename Topology>
+constexpr BoardGeometry make_fitting_geometry(
+    const Topology& topology,
+    const int32 width,
+    const int32 height)
+{
+    return fits_bitboard(width, height) ?
+        BoardGeometry(topology, width, height) :
+        BoardGeometry(topology, 0, 0);
+}
@@ -0,0 +1,132 @@
+#include "bitboard_engine.h"
+
+void move_to_state(
+    Bitboard* room_state,
+    const Bitboard& rooms,
+    const RoomState state)
+{
+    for (int32 i = 0; i < rs__Count; i++)
+    {
+        room_state[i] &= ~rooms;
+    }
+    room_state[state] |= rooms;
+}
+
+void update_maybe_states(
+    BoardMasks& masks,
+    const BoardGeometry& geometry,
+    const Attribute attrib)
+{
+    Bitboard* room_state = masks.m_room_state[attrib];
+    Bitboard open = geometry.all() & ~(room_state[rs_No] | room_state[rs_Yes]);
+    Bitboard warned = geometry.neighbors_of(masks.m_neighbor_state[attrib][ns_Yes]);
+
+    room_state[rs_Maybe] = open & warned;
+    room_state[rs_Unknown] = open & ~warned;
+}
+
+int32 get_hazard_count(
+    const BoardMasks& masks,
+    const Attribute attrib)
+{
+    if (masks.m_hazard_count[attrib] >= 0)
+        return masks.m_hazard_count[attrib];
+
+    return is_hazard_unique(attrib) ? 1 : -1;
+}
+
+bool apply_hazard_count(
+    BoardMasks& masks,
+    const BoardGeometry& geometry,
+    const Attribute attrib)
+{
+    int32 count = get_hazard_count(masks, attrib);
+    if (count < 0)
+        return false;
+
+    Bitboard* room_state = masks.m_room_state[attrib];
+    Bitboard open = geometry.all() & ~(room_state[rs_No] | room_state[rs_Yes]);
+    if (!open.any())
+        return false;
+
+    int32 found = room_state[rs_Yes].count();
+    if (found >= count)
+    {
+        move_to_state(room_state, open, rs_No);
+        return true;
+    }
+
+    if (found + open.count() == count)
+    {
+        move_to_state(room_state, open, rs_Yes);
+        return true;
+    }
+
+    return false;
+}
+
+BitboardEngine::BitboardEngine(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+}
+
+void BitboardEngine::update_room_states(
+    BoardMasks& masks) const
+{
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        update_room_states_attr(masks, (Attribute)i);
+    }
+}
+
+void BitboardEngine::update_room_states_attr(
+    BoardMasks& masks,
+    const Attribute attrib) const
+{
+    Bitboard* room_state = masks.m_room_state[attrib];
+    const Bitboard* neighbor_state = masks.m_neighbor_state[attrib];
+    const Bitboard& all = m_geometry.all();
+
+    // "No" pass: everything not already decided is reset, then rooms next
+    // to a room without a warning are known to be empty.
+    Bitboard open = all & ~(room_state[rs_No] | room_state[rs_Yes]);
+    Bitboard no = open & m_geometry.neighbors_of(neighbor_state[ns_No]);
+    room_state[rs_No] |= no;
+    open &= ~no;
+
+    // "Maybe/Yes" pass: Room::update_room_state_attr_maybe_yes() only looks
+    // at the first neighbor with a warning, in the topology's order.
+    Bitboard warning = neighbor_state[ns_Yes];
+    Bitboard sure = warning & get_single_open_neighbor(all & ~room_state[rs_No]);
+
+    Bitboard yes;
+    Bitboard seen;
+    for (int32 d = 0; d < m_geometry.direction_count(); d++)
+    {
+        Bitboard has_warning = m_geometry.from(d, warning);
+        yes |= has_warning & ~seen & m_geometry.from(d, sure);
+        seen |= has_warning;
+    }
+
+    room_state[rs_Yes] |= open & yes;
+    room_state[rs_Maybe] = open & seen & ~yes;
+    room_state[rs_Unknown] = open & ~seen;
+}
+
+Bitboard BitboardEngine::get_single_open_neighbor(
+    const Bitboard& open) const
+{
+    // Room counts rs_No neighbors, which is the same thing with walls
+    // counted as rs_No: from() leaves their bits out of open.
+    Bitboard once;
+    Bitboard more;
+    for (int32 d = 0; d < m_geometry.direction_count(); d++)
+    {
+        Bitboard n = m_geometry.from(d, open);
+        more |= once & n;
+        once |= n;
+    }
+
+    return once & ~more;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "bitboard.h"
+
+//////////////////////////////
+// BoardMasks
+//////////////////////////////
+
+// Everything the inference rules know about a board, one mask per
+// attribute/state pair. Each attribute's state masks partition the board.
+struct BoardMasks
+{
+    Bitboard m_visited;
+    Bitboard m_neighbor_state[a__Count][ns__Count];
+    Bitboard m_room_state[a__Count][rs__Count];
+    int32 m_hazard_count[a__Count]{ -1, -1, -1 };  // negative when unknown
+
+    bool operator== (
+        const BoardMasks& other) const = default;
+};
+
+// Number of rooms holding the hazard, -1 when unknown. The dragon is
+// always alone.
+int32 get_hazard_count(
+    const BoardMasks& masks,
+    const Attribute attrib);
+
+// Once every hazard is found the undecided rooms are empty, and when the
+// undecided rooms are just enough for the missing hazards they all hold
+// one. Returns true if any room changed.
+bool apply_hazard_count(
+    BoardMasks& masks,
+    const BoardGeometry& geometry,
+    const Attribute attrib);
+
+// Moves the given rooms of one attribute to a single state.
+void move_to_state(
+    Bitboard* room_state,
+    const Bitboard& rooms,
+    const RoomState state);
+
+// Undecided rooms next to a warning become rs_Maybe, the rest rs_Unknown.
+void update_maybe_states(
+    BoardMasks& masks,
+    const BoardGeometry& geometry,
+    const Attribute attrib);
+
+//////////////////////////////
+// BitboardEngine class
+//////////////////////////////
+
+// Word-parallel version of Room::update_room_state_no() followed by
+// Room::update_room_state_maybe_yes() over the whole board.
+class BitboardEngine
+{
+public:
+    BitboardEngine(
+        const BoardGeometry& geometry);
+
+    void update_room_states(
+        BoardMasks& masks) const;
+
+    const BoardGeometry& get_geometry() const { return m_geometry; }
+
+private:
+    BoardGeometry m_geometry;
+
+    void update_room_states_attr(
+        BoardMasks& masks,
+        const Attribute attrib) const;
+
+    // Rooms with exactly one neighbor in open.
+    Bitboard get_single_open_neighbor(
+        const Bitboard& open) const;
+};
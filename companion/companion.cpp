@@ -1,5 +1,6 @@
 #include "companion.h"
 #include "dungeon.h"
+#include "session.h"
 #include "imgui.h"
 
 // Naming conventions:
@@ -32,6 +33,10 @@ constexpr float room_font_size_mult_base = 0.28f;
 
 static float window_scale = 1.0f;
 
+// Next to imgui.ini, in the working directory.
+static const std::string session_path = "companion_session.bin";
+static const std::string log_path = "companion_log.bin";
+
 extern float room_screen_size;
 extern float room_font_size_mult;
 
@@ -97,6 +102,31 @@ constexpr uint32 windowSettings =
 class Companion
 {
 public:
+    Companion() :
+        m_autosaver(session_path)
+    {
+        MappedFile session(session_path);
+        bool loaded = m_dungeon.load_session(session.get_data(), session.get_size());
+        m_saved_revision = m_dungeon.get_revision();
+
+        // The log goes on with the session it was recorded with. A new
+        // one starts with the board the session left, so that it still
+        // replays to it.
+        ObservationLogReader log(log_path);
+        bool append =
+            loaded && log.is_valid() &&
+            log.get_topology() == Torus::id &&
+            log.get_width() == m_dungeon.get_width() &&
+            log.get_height() == m_dungeon.get_height();
+        if (!append)
+        {
+            m_log.begin(Torus::id, m_dungeon.get_width(), m_dungeon.get_height());
+        }
+
+        m_log_appender = std::make_unique<LogAppender>(log_path, append);
+        m_dungeon.set_log(&m_log, !append);
+    }
+
     void draw()
     {
         const Layout& layout = find_best_layout();
@@ -114,6 +144,10 @@ public:
         ImGui::Begin("Companion", 0, windowSettings);
         ImGui::Text("Welcome to Mattel DnD Portable Companion!");
         ImGui::Text("v0.5.1             (c) 2020 BussardRamjet");
+        if (m_autosaver.has_failed() || m_log_appender->has_failed())
+        {
+            ImGui::TextColored({ 1.f, 0.4f, 0.4f, 1.f }, "Autosave failed");
+        }
         ImGui::End();
 
         ImGui::SetNextWindowPos(layout.m_dungeonPos * window_scale);
@@ -130,16 +164,23 @@ public:
         ImGui::Begin("Actions", 0, windowSettings);
         actions_draw();
         ImGui::End();
-    }
 
-    const Room& get_dungeon_room(
-        const ivec2& room_pos)
-    {
-        return m_dungeon.get_room(room_pos);
+        // Serialized here, written to disk by the autosaver's and the
+        // appender's threads.
+        if (m_dungeon.get_revision() != m_saved_revision)
+        {
+            m_saved_revision = m_dungeon.get_revision();
+            m_autosaver.save(m_dungeon.save_session());
+        }
+        m_log_appender->append(m_log.take_pending());
     }
 
 private:
-    Dungeon m_dungeon;
+    Dungeon<> m_dungeon;
+    Autosaver m_autosaver;
+    uint64 m_saved_revision = 0;
+    ObservationLog m_log;
+    std::unique_ptr<LogAppender> m_log_appender;
 
     bool m_dragon = false;
     bool m_pit = false;
@@ -213,6 +254,22 @@ private:
         {
             m_dungeon.found_a_pit();
         }
+
+        ImGui::Separator();
+
+        bool ctrl = ImGui::GetIO().KeyCtrl;
+        if ((ImGui::Button("Undo") || (ctrl && ImGui::IsKeyPressed('Z'))) &&
+            m_dungeon.can_undo())
+        {
+            m_dungeon.undo();
+        }
+        ImGui::SameLine();
+
+        if ((ImGui::Button("Redo") || (ctrl && ImGui::IsKeyPressed('Y'))) &&
+            m_dungeon.can_redo())
+        {
+            m_dungeon.redo();
+        }
     }
 
     const Layout& find_best_layout() const
@@ -233,19 +290,21 @@ private:
     }
 };
 
-static Companion s_companion;
-
-const Room& get_dungeon_room(
-    const ivec2& room_pos)
+//////////////////////////////
+// Main entry point
+//////////////////////////////
+static Companion& get_companion()
 {
-    return s_companion.get_dungeon_room(room_pos);
+    static Companion s_companion;
+    return s_companion;
 }
 
+void companion_load()
+{
+    get_companion();
+}
 
-//////////////////////////////
-// Main entry point
-//////////////////////////////
 void companion_draw()
 {
-    s_companion.draw();
+    get_companion().draw();
 }
\ No newline at end of file
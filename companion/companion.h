@@ -1,3 +1,8 @@
 #pragma once
 
+// Loads the last session and log and starts the threads that save them.
+// Meant to be called once before the first frame, which does it
+// otherwise.
+void companion_load();
+
 void companion_draw();
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "contradiction.h"
+
+ContradictionDetector::ContradictionDetector(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry),
+    m_solver(geometry)
+{
+}
+
+bool ContradictionDetector::has_conflict(
+    const BoardMasks& masks,
+    const Attribute attrib) const
+{
+    const Bitboard* room_state = masks.m_room_state[attrib];
+    const Bitboard* neighbor_state = masks.m_neighbor_state[attrib];
+
+    Bitboard possible = m_geometry.all() & ~room_state[rs_No];
+    if ((neighbor_state[ns_Yes] & ~m_geometry.neighbors_of(possible)).any())
+        return true;
+
+    if ((room_state[rs_Yes] & m_geometry.neighbors_of(neighbor_state[ns_No])).any())
+        return true;
+
+    int32 count = get_hazard_count(masks, attrib);
+    return count >= 0 &&
+        (room_state[rs_Yes].count() > count || possible.count() < count);
+}
+
+Contradiction ContradictionDetector::find_minimal_conflict(
+    const BoardMasks& masks,
+    const Bitboard& assumed,
+    const Attribute attrib)
+{
+    Bitboard rooms = masks.m_visited | assumed;
+    BoardMasks observed = get_observed(masks, attrib, rooms);
+    if (observed == m_found_from[attrib])
+        return m_found[attrib];
+
+    // Consistent as a whole when only what was deduced conflicts, which
+    // leaves nothing to blame.
+    Contradiction contradiction;
+    contradiction.m_found = true;
+    if (!is_consistent(observed, attrib))
+    {
+        Bitboard candidates = rooms;
+        while (candidates.any())
+        {
+            int32 index = candidates.first();
+            candidates.reset(index);
+
+            Bitboard without = rooms;
+            without.reset(index);
+            if (!is_consistent(get_observed(masks, attrib, without), attrib))
+            {
+                rooms = without;
+            }
+        }
+
+        contradiction.m_observations = rooms & masks.m_visited;
+        contradiction.m_assumed = rooms & ~masks.m_visited;
+    }
+
+    m_found_from[attrib] = observed;
+    m_found[attrib] = contradiction;
+    return contradiction;
+}
+
+BoardMasks ContradictionDetector::get_observed(
+    const BoardMasks& masks,
+    const Attribute attrib,
+    const Bitboard& rooms) const
+{
+    Bitboard observations = rooms & masks.m_visited;
+    Bitboard assumed = rooms & ~masks.m_visited;
+
+    BoardMasks observed;
+    observed.m_visited = observations;
+    observed.m_hazard_count[attrib] = masks.m_hazard_count[attrib];
+
+    for (int32 state = 0; state < ns__Count; state++)
+    {
+        observed.m_neighbor_state[attrib][state] = masks.m_neighbor_state[attrib][state] & observations;
+    }
+    observed.m_neighbor_state[attrib][ns_Unknown] |= m_geometry.all() & ~observations;
+
+    Bitboard found = masks.m_room_state[attrib][rs_Yes] & rooms;
+    Bitboard empty = (observations | (masks.m_room_state[attrib][rs_No] & assumed)) & ~found;
+    observed.m_room_state[attrib][rs_Yes] = found;
+    observed.m_room_state[attrib][rs_No] = empty;
+    observed.m_room_state[attrib][rs_Unknown] = m_geometry.all() & ~found & ~empty;
+
+    return observed;
+}
+
+bool ContradictionDetector::is_consistent(
+    const BoardMasks& observed,
+    const Attribute attrib)
+{
+    SolverStats stats;
+    return m_solver.is_satisfiable(m_solver.make_problem(observed, attrib), stats);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "entailment_solver.h"
+
+//////////////////////////////
+// Contradiction
+//////////////////////////////
+
+struct Contradiction
+{
+    bool m_found = false;
+    Bitboard m_observations;    // visited rooms that conflict
+    Bitboard m_assumed;         // unvisited rooms set by hand that conflict
+};
+
+//////////////////////////////
+// ContradictionDetector class
+//////////////////////////////
+
+// Spots boards that no placement fits, and names the observations and
+// the rooms set by hand to blame.
+//
+// The check after each observation is a handful of mask operations: a
+// warning whose neighbors are all empty, a known hazard next to a room
+// without a warning, or a hazard count that is exceeded or can no longer
+// be reached. Only when one of them fires, the visited and hand-set
+// rooms are shrunk to a minimal conflicting set: a room is dropped
+// whenever the remaining ones still conflict, which leaves a set where
+// every single room is needed for the conflict. The set is kept until
+// what was observed or set by hand changes, so a conflict that stays
+// while the board is browsed is shrunk once.
+class ContradictionDetector
+{
+public:
+    ContradictionDetector(
+        const BoardGeometry& geometry);
+
+    bool has_conflict(
+        const BoardMasks& masks,
+        const Attribute attrib) const;
+
+    // The assumed rooms are the unvisited ones set by hand.
+    Contradiction find_minimal_conflict(
+        const BoardMasks& masks,
+        const Bitboard& assumed,
+        const Attribute attrib);
+
+private:
+    BoardGeometry m_geometry;
+    EntailmentSolver m_solver;
+
+    // The last set found for each attribute, and what it was found from.
+    BoardMasks m_found_from[a__Count];
+    Contradiction m_found[a__Count];
+
+    // What was observed in the given visited rooms and set by hand in
+    // the given unvisited ones, nothing deduced.
+    BoardMasks get_observed(
+        const BoardMasks& masks,
+        const Attribute attrib,
+        const Bitboard& rooms) const;
+
+    bool is_consistent(
+        const BoardMasks& observed,
+        const Attribute attrib);
+};
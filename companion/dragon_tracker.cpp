@@ -0,0 +1,78 @@
+#include "dragon_tracker.h"
+
+DragonTracker::DragonTracker(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+    for (int32 i = 0; i < m_geometry.room_count(); i++)
+    {
+        Bitboard room;
+        room.set(i);
+        m_room_neighbors[i] = m_geometry.neighbors_of(room);
+    }
+
+    reset();
+}
+
+void DragonTracker::reset()
+{
+    m_candidates = m_geometry.all();
+}
+
+void DragonTracker::observe(
+    const int32 index,
+    const NeighborState warning)
+{
+    m_candidates.reset(index);
+
+    if (warning == ns_Yes)
+        m_candidates &= m_room_neighbors[index];
+    else if (warning == ns_No)
+        m_candidates &= ~m_room_neighbors[index];
+}
+
+void DragonTracker::rebuild(
+    const BoardMasks& masks)
+{
+    const Bitboard* room_state = masks.m_room_state[a_Dragon];
+    const Bitboard* neighbor_state = masks.m_neighbor_state[a_Dragon];
+
+    m_candidates = m_geometry.all() & ~room_state[rs_No] & ~m_geometry.neighbors_of(neighbor_state[ns_No]);
+
+    Bitboard warnings = neighbor_state[ns_Yes];
+    while (warnings.any())
+    {
+        int32 index = warnings.first();
+        warnings.reset(index);
+        m_candidates &= m_room_neighbors[index];
+    }
+}
+
+bool DragonTracker::apply(
+    BoardMasks& masks) const
+{
+    Bitboard* room_state = masks.m_room_state[a_Dragon];
+
+    Bitboard candidates = m_candidates;
+    if (room_state[rs_Yes].any())
+        candidates &= room_state[rs_Yes];
+
+    if (!candidates.any())
+        return false;
+
+    bool changed = false;
+    Bitboard no = m_geometry.all() & ~candidates & ~room_state[rs_No] & ~room_state[rs_Yes];
+    if (no.any())
+    {
+        move_to_state(room_state, no, rs_No);
+        changed = true;
+    }
+
+    if (candidates.count() == 1 && !(candidates & room_state[rs_Yes]).any())
+    {
+        move_to_state(room_state, candidates, rs_Yes);
+        changed = true;
+    }
+
+    return changed;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "bitboard_engine.h"
+
+//////////////////////////////
+// DragonTracker class
+//////////////////////////////
+
+// The rooms the single dragon can still be in. A room with a dragon
+// warning keeps only its neighbors, a room without one rules its
+// neighbors out, and a visited room rules itself out, each a couple of
+// word operations per observation. Once one candidate is left the dragon
+// is found, long before a warning has three empty neighbors.
+class DragonTracker
+{
+public:
+    DragonTracker(
+        const BoardGeometry& geometry);
+
+    void reset();
+
+    // A visited room and its dragon warning.
+    void observe(
+        const int32 index,
+        const NeighborState warning);
+
+    // Starts over from the board, for rooms edited by hand.
+    void rebuild(
+        const BoardMasks& masks);
+
+    // Rooms outside the candidates become rs_No and a last candidate
+    // rs_Yes. Returns true if any room changed, false as well when no
+    // candidate is left as the observations contradict each other.
+    bool apply(
+        BoardMasks& masks) const;
+
+    const Bitboard& get_candidates() const { return m_candidates; }
+
+private:
+    BoardGeometry m_geometry;
+    Bitboard m_room_neighbors[bitboard_capacity];
+    Bitboard m_candidates;
+};
@@ -1,6 +1,28 @@
+#include <algorithm>
+#include <cstring>
 #include "dungeon.h"
 
-constexpr int dungeon_size = 10;
+// Chained deductions must not stall a keystroke.
+constexpr std::chrono::microseconds fixpoint_budget{ 1000 };
+
+// Larger warning groups are sampled instead of counted exactly. Exact
+// counting takes about 2 ms for 40 rooms on 11x11 boards crowded with
+// hazards, and doubles every 5 to 8 rooms beyond. The 10x10 board with
+// the handheld's hazards never gets past 21.
+constexpr int32 exact_component_limit = 40;
+
+const MonteCarloSettings monte_carlo_settings
+{
+    .m_tolerance = 0.02f,
+    .m_time_limit = std::chrono::milliseconds(30),
+};
+
+// Hazards placed by the handheld, adjustable in the UI. Used as known
+// totals when enabled and always as noisy observations priors.
+constexpr int32 default_hazard_counts[]{ 8, 4, 1 };
+
+// Rooms below this belief are not labeled in noisy observations mode.
+constexpr float belief_visible_threshold = 0.15f;
 
 float room_screen_size;
 float room_font_size_mult;
@@ -18,10 +40,11 @@ const std::string s_neighbor_state_labels[]
 
 static_assert(ns__Count == std::size(s_neighbor_state_labels));
 
-void draw_neighbor_state(
+bool draw_neighbor_state(
     const char* name,
     NeighborState* pState)
 {
+    bool changed = false;
     ImGui::Text(name);
     ImGui::SameLine();
 
@@ -35,11 +58,14 @@ void draw_neighbor_state(
                 s_neighbor_state_labels[i].c_str(),
                 *pState == i))
             {
+                changed |= *pState != i;
                 *pState = (NeighborState)i;
             }
         }
         ImGui::EndCombo();
     }
+
+    return changed;
 }
 
 //////////////////////////////
@@ -74,10 +100,29 @@ constexpr ImU32 get_state_color(
         IM_COL32(255, 0, 0, 255);
 }
 
-void draw_room_state(
+// Yellow for unlikely hazards, fading towards the rs_Yes red.
+ImU32 get_probability_color(
+    const float probability)
+{
+    return IM_COL32(255, (int32)(255.f * (1.f - probability)), 0, 255);
+}
+
+// Maybe rooms fade from yellow towards the rs_Yes red as they get likelier.
+ImU32 get_state_color(
+    const RoomState state,
+    const float probability)
+{
+    if (state != rs_Maybe || probability < 0.f)
+        return get_state_color(state);
+
+    return get_probability_color(probability);
+}
+
+bool draw_room_state(
     const char* name,
     RoomState* pState)
 {
+    bool changed = false;
     ImGui::Text(name);
     ImGui::SameLine();
 
@@ -91,11 +136,14 @@ void draw_room_state(
                 s_room_state_labels[i].c_str(),
                 *pState == i))
             {
+                changed |= *pState != i;
                 *pState = (RoomState)i;
             }
         }
         ImGui::EndCombo();
     }
+
+    return changed;
 }
 
 //////////////////////////////
@@ -110,49 +158,227 @@ const std::string s_attribute_labels[]
 };
 
 static_assert(a__Count == std::size(s_attribute_labels));
+static_assert(a__Count == std::size(default_hazard_counts));
+
+// A to Z, then AA, AB and so on, the way spreadsheets name columns.
+std::string get_row_label(
+    int32 row)
+{
+    std::string label;
+    for (row++; row > 0; row = (row - 1) / 26)
+    {
+        label.insert(label.begin(), char('A' + (row - 1) % 26));
+    }
+    return label;
+}
+
+// "A:3 B:7" style positions, same as the details panel.
+std::string get_room_labels(
+    Bitboard rooms,
+    const int32 width)
+{
+    std::string labels;
+    while (rooms.any())
+    {
+        int32 index = rooms.first();
+        rooms.reset(index);
+
+        if (!labels.empty())
+            labels += ' ';
 
-const Room& get_dungeon_room(
-    const ivec2& room_pos);
+        labels += get_row_label(index / width);
+        labels += ':' + std::to_string(index % width);
+    }
+    return labels;
+}
+
+//////////////////////////////
+// Board masks
+//////////////////////////////
 
-Room::Room(
-    const ivec2& pos) :
-    m_pos(pos)
+// Rooms are converted eight at a time, a byte of state per room against
+// a byte of a mask word, and one at a time for the last few. With a
+// constant room count the loops unroll completely.
+constexpr uint64 byte_ones = 0x0101010101010101ull;
+constexpr uint64 byte_high_bits = 0x8080808080808080ull;
+
+// Bit plane of the values, the rooms whose byte has the given bit set.
+Bitboard select_value_bit(
+    const uint8* values,
+    const int32 bit,
+    const int32 room_count)
 {
-    reset();
+    Bitboard rooms;
+    int32 index = 0;
+    for (; index + 8 <= room_count; index += 8)
+    {
+        uint64 bytes;
+        std::memcpy(&bytes, values + index, sizeof(bytes));
+
+        // The bit moved to the low bit of every byte, then those 8 bits
+        // gathered into the top byte.
+        uint64 bits = ((((bytes >> bit) & byte_ones) * 0x0102040810204080ull) >> 56);
+        rooms.m_words[index >> 6] |= bits << (index & 63);
+    }
+
+    for (; index < room_count; index++)
+    {
+        rooms.m_words[index >> 6] |= (uint64)((values[index] >> bit) & 1) << (index & 63);
+    }
+    return rooms;
+}
+
+// The other way around, values from their two bit planes.
+void store_values(
+    const Bitboard* planes,
+    uint8* values,
+    const int32 room_count)
+{
+    int32 index = 0;
+    for (; index + 8 <= room_count; index += 8)
+    {
+        uint64 bytes = 0;
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            // The 8 plane bits spread to the low bit of 8 bytes.
+            uint64 bits = (planes[bit].m_words[index >> 6] >> (index & 63)) & 0xFF;
+            uint64 spread = (bits * byte_ones) & 0x8040201008040201ull;
+            bytes |= (((spread + ~byte_high_bits) & byte_high_bits) >> 7) << bit;
+        }
+        std::memcpy(values + index, &bytes, sizeof(bytes));
+    }
+
+    for (; index < room_count; index++)
+    {
+        values[index] = (uint8)(planes[0].test(index) | (planes[1].test(index) << 1));
+    }
+}
+
+PackedRoom pack_observation(
+    const Observation& observation)
+{
+    PackedRoom room = (PackedRoom)observation.m_visited;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        room |= (PackedRoom)(observation.m_warning[a] << get_neighbor_state_shift((Attribute)a));
+        room |= (PackedRoom)(observation.m_room_state[a] << get_room_state_shift((Attribute)a));
+    }
+    return room;
+}
+
+Observation unpack_observation(
+    const PackedRoom room)
+{
+    Observation observation;
+    observation.m_visited = room & 1;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        observation.m_warning[a] = (NeighborState)((room >> get_neighbor_state_shift((Attribute)a)) & 3);
+        observation.m_room_state[a] = (RoomState)((room >> get_room_state_shift((Attribute)a)) & 3);
+    }
+    return observation;
+}
+
+void write_rooms(
+    SessionWriter& writer,
+    const PackedRooms& rooms)
+{
+    auto write_board = [&](const Bitboard& board)
+    {
+        for (uint64 word : board.m_words)
+        {
+            writer.write(word);
+        }
+    };
+
+    write_board(rooms.m_visited);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            write_board(rooms.m_neighbor_state[a][bit]);
+            write_board(rooms.m_room_state[a][bit]);
+        }
+    }
+}
+
+void read_rooms(
+    SessionReader& reader,
+    PackedRooms& rooms)
+{
+    auto read_board = [&](Bitboard& board)
+    {
+        for (uint64& word : board.m_words)
+        {
+            reader.read(word);
+        }
+    };
+
+    read_board(rooms.m_visited);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            read_board(rooms.m_neighbor_state[a][bit]);
+            read_board(rooms.m_room_state[a][bit]);
+        }
+    }
 }
 
-void Room::reset()
+//////////////////////////////
+// DeductionRule
+//////////////////////////////
+
+const std::string s_deduction_rule_labels[]
+{
+    "set by hand",
+    "visited",
+    "next to a room without a warning",
+    "last candidate of a warning",
+    "not next to a dragon warning",
+    "hazard count",
+    "all observations together",
+};
+
+static_assert(dr__Count == std::size(s_deduction_rule_labels));
+
+template <int32 Width, int32 Height, typename Topology>
+void Room<Width, Height, Topology>::reset()
 {
-    m_visited = false;
+    set_visited(false);
     for (int32 i = 0; i < a__Count; i++)
     {
-        m_neighbor_state[i] = ns_Unknown;
-        m_room_state[i] = rs_Unknown;
+        set_neighbor_state((Attribute)i, ns_Unknown);
+        set_room_state((Attribute)i, rs_Unknown);
+        m_store->get_estimate(m_index, (Attribute)i) = {};
     }
 }
 
-void Room::update_room_state_no()
+template <int32 Width, int32 Height, typename Topology>
+void Room<Width, Height, Topology>::update_room_state_no()
 {
-    NeighborArray neighbor_rooms = get_neighbor_rooms();
+    const NeighborArray<Topology>& neighbors = m_store->get_neighbors(m_index);
     for (int32 i = 0; i < a__Count; i++)
     {
-        update_room_state_attr_no((Attribute)i, neighbor_rooms);
+        update_room_state_attr_no((Attribute)i, neighbors);
     }
 }
 
-void Room::update_room_state_maybe_yes()
+template <int32 Width, int32 Height, typename Topology>
+void Room<Width, Height, Topology>::update_room_state_maybe_yes()
 {
-    NeighborArray neighbor_rooms = get_neighbor_rooms();
+    const NeighborArray<Topology>& neighbors = m_store->get_neighbors(m_index);
     for (int32 i = 0; i < a__Count; i++)
     {
-        update_room_state_attr_maybe_yes((Attribute)i, neighbor_rooms);
+        update_room_state_attr_maybe_yes((Attribute)i, neighbors);
     }
 }
 
-bool Room::draw(
+template <int32 Width, int32 Height, typename Topology>
+bool Room<Width, Height, Topology>::draw(
     ImU32 background_alpha,
     const ImVec2& room_pos,
-    ImDrawList& draw_list)
+    ImDrawList& draw_list) const
 {
     ImVec2 room_pos_max{ room_pos.x + room_screen_size, room_pos.y + room_screen_size };
     bool hovered = ImGui::IsMouseHoveringRect(room_pos, room_pos_max);
@@ -163,16 +389,16 @@ bool Room::draw(
     }
 
     ImU32 color = IM_COL32(255, 255, 255, background_alpha);
-    if (m_visited)
+    if (is_visited())
     {
         color = IM_COL32(32, 32, 32, background_alpha);
     }
 
     draw_list.AddRectFilled(room_pos, room_pos_max, color);
 
-    if (m_room_state[a_Dragon] == rs_Unknown &&
-        m_room_state[a_Arrow] == rs_Unknown &&
-        m_room_state[a_Pit] == rs_Unknown)
+    if (get_room_state(a_Dragon) == rs_Unknown &&
+        get_room_state(a_Arrow) == rs_Unknown &&
+        get_room_state(a_Pit) == rs_Unknown)
     {
         draw_list.AddText(
             nullptr,
@@ -184,9 +410,9 @@ bool Room::draw(
     else
     {
         int lineCounter =
-            (int32)(is_state_visible(m_room_state[a_Dragon])) +
-            (int32)(is_state_visible(m_room_state[a_Arrow])) +
-            (int32)(is_state_visible(m_room_state[a_Pit]));
+            (int32)(is_attr_visible(a_Dragon)) +
+            (int32)(is_attr_visible(a_Arrow)) +
+            (int32)(is_attr_visible(a_Pit));
 
         if (lineCounter != 0)
         {
@@ -207,13 +433,13 @@ bool Room::draw(
 
             for (int32 i = 0; i < a__Count; i++)
             {
-                if (is_state_visible(m_room_state[i]))
+                if (is_attr_visible((Attribute)i))
                 {
                     draw_list.AddText(
                         nullptr,
                         room_screen_size * room_font_size_mult,
                         { pos.x + room_screen_size * 0.05f, pos.y },
-                        get_state_color(m_room_state[i]),
+                        get_attr_color((Attribute)i),
                         s_attribute_labels[i].c_str());
 
                     pos.y += lineHeight;
@@ -225,317 +451,1836 @@ bool Room::draw(
     return hovered && ImGui::IsMouseClicked(0);
 }
 
-NeighborArray Room::get_neighbor_rooms() const
+// With noisy observations the beliefs replace the deduced states, which
+// a single wrong observation can get wrong for good.
+template <int32 Width, int32 Height, typename Topology>
+bool Room<Width, Height, Topology>::is_attr_visible(
+    const Attribute attrib) const
 {
-    return {
-        &get_dungeon_room(ivec2{ m_pos.x - 1, m_pos.y }),
-        &get_dungeon_room(ivec2{ m_pos.x + 1, m_pos.y }),
-        &get_dungeon_room(ivec2{ m_pos.x, m_pos.y - 1 }),
-        &get_dungeon_room(ivec2{ m_pos.x, m_pos.y + 1 })
-    };
+    const HazardEstimate& estimate = get_estimate(attrib);
+    if (estimate.m_belief >= 0.f)
+        return !is_visited() && estimate.m_belief >= belief_visible_threshold;
+
+    return is_state_visible(get_room_state(attrib));
 }
 
-NeighborState Room::get_neighbor_state(
+template <int32 Width, int32 Height, typename Topology>
+ImU32 Room<Width, Height, Topology>::get_attr_color(
     const Attribute attrib) const
 {
-    NeighborArray neighbor_rooms = get_neighbor_rooms();
-
-    for (auto neighbor_room : neighbor_rooms)
-    {
-        if (neighbor_room->m_neighbor_state[attrib] == ns_No)
-            return ns_No;
-    }
-
-    for (auto neighbor_room : neighbor_rooms)
-    {
-        if (neighbor_room->m_neighbor_state[attrib] == ns_Yes)
-            return ns_Yes;
-    }
+    const HazardEstimate& estimate = get_estimate(attrib);
+    if (estimate.m_belief >= 0.f)
+        return get_probability_color(estimate.m_belief);
 
-    return ns_Unknown;
+    return get_state_color(get_room_state(attrib), estimate.m_probability);
 }
 
-void Room::update_room_state_attr_no(
+template <int32 Width, int32 Height, typename Topology>
+void Room<Width, Height, Topology>::update_room_state_attr_no(
     const Attribute attrib,
-    const NeighborArray& neighbor_rooms)
+    const NeighborArray<Topology>& neighbors)
 {
-    if (m_room_state[attrib] == rs_No ||
-        m_room_state[attrib] == rs_Yes)
+    if (get_room_state(attrib) == rs_No ||
+        get_room_state(attrib) == rs_Yes)
     {
         return;
     }
 
-    m_room_state[attrib] = rs_Unknown;
+    set_room_state(attrib, rs_Unknown);
 
-    for (auto neighbor_room : neighbor_rooms)
+    for (int32 neighbor : neighbors)
     {
-        if (neighbor_room->m_neighbor_state[attrib] == ns_No)
+        if (m_store->get_neighbor_state(neighbor, attrib) == ns_No)
         {
-            m_room_state[attrib] = rs_No;
+            set_room_state(attrib, rs_No);
         }
     }
 }
 
-int32 Room::get_neighbor_attr_no_count(
+template <int32 Width, int32 Height, typename Topology>
+int32 Room<Width, Height, Topology>::get_attr_no_count(
+    const int32 index,
     const Attribute attrib) const
 {
-    NeighborArray neighbor_rooms = get_neighbor_rooms();
-
-    return
-        (int32)(neighbor_rooms[0]->m_room_state[attrib] == rs_No) +
-        (int32)(neighbor_rooms[1]->m_room_state[attrib] == rs_No) +
-        (int32)(neighbor_rooms[2]->m_room_state[attrib] == rs_No) +
-        (int32)(neighbor_rooms[3]->m_room_state[attrib] == rs_No);
+    int32 count = 0;
+    for (int32 neighbor : m_store->get_neighbors(index))
+    {
+        count += (int32)(m_store->get_room_state(neighbor, attrib) == rs_No);
+    }
+    return count;
 }
 
-void Room::update_room_state_attr_maybe_yes(
+template <int32 Width, int32 Height, typename Topology>
+void Room<Width, Height, Topology>::update_room_state_attr_maybe_yes(
     const Attribute attrib,
-    const NeighborArray& neighbor_rooms)
+    const NeighborArray<Topology>& neighbors)
 {
-    if (m_room_state[attrib] == rs_No ||
-        m_room_state[attrib] == rs_Yes)
+    if (get_room_state(attrib) == rs_No ||
+        get_room_state(attrib) == rs_Yes)
     {
         return;
     }
 
-    for (auto neighbor_room : neighbor_rooms)
+    for (int32 neighbor : neighbors)
     {
-        if (neighbor_room->m_neighbor_state[attrib] == ns_Yes)
+        if (m_store->get_neighbor_state(neighbor, attrib) == ns_Yes)
         {
-            m_room_state[attrib] = neighbor_room->get_neighbor_attr_no_count(attrib) == 3 ? rs_Yes : rs_Maybe;
+            bool last_candidate = get_attr_no_count(neighbor, attrib) == Topology::direction_count - 1;
+            set_room_state(attrib, last_candidate ? rs_Yes : rs_Maybe);
         }
 
-        if (m_room_state[attrib] != rs_Unknown)
+        if (get_room_state(attrib) != rs_Unknown)
         {
             return;
         }
     }
 }
 
-Dungeon::Dungeon()
+template <int32 Width, int32 Height, typename Topology>
+Dungeon<Width, Height, Topology>::Dungeon(
+    const int32 sampler_threads) requires (!RoomStore<Width, Height, Topology>::is_dynamic) :
+    Dungeon(Width, Height, BoardGeometry(Topology{}, Width, Height), sampler_threads)
 {
-    for (int y = 0; y < dungeon_size; y++)
-    {
-        RoomRow row;
-        for (int x = 0; x < dungeon_size; x++)
-        {
-            row.push_back({ ivec2{x, y} });
-        }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+Dungeon<Width, Height, Topology>::Dungeon(
+    const int32 width,
+    const int32 height,
+    const int32 sampler_threads) requires (RoomStore<Width, Height, Topology>::is_dynamic) :
+    Dungeon(width, height, make_fitting_geometry(Topology{}, width, height), sampler_threads)
+{
+}
 
-        m_rows.push_back(row);
+template <int32 Width, int32 Height, typename Topology>
+Dungeon<Width, Height, Topology>::Dungeon(
+    const int32 width,
+    const int32 height,
+    const BoardGeometry& geometry,
+    const int32 sampler_threads) :
+    m_rooms(width, height),
+    m_observations(width * height),
+    m_bitboard_engine(geometry),
+    m_dragon_tracker(geometry),
+    m_provenance_tracker(geometry),
+    m_contradiction_detector(geometry),
+    m_fixpoint_engine(geometry),
+    m_entailment_solver(geometry),
+    m_sampler_threads(sampler_threads),
+    m_worklist_stamps(width * height, 0)
+{
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        m_belief_engines.emplace_back(width, height);
+        m_hazard_counts[i] = default_hazard_counts[i];
     }
 }
 
-void Dungeon::draw()
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::draw()
 {
-    float dungeon_screen_size = (dungeon_size + 1) * room_screen_size;
+    // No step is under way, what is shown is for the board as it is.
+    if (is_estimating())
+    {
+        poll_estimates();
+        if (!is_estimating())
+        {
+            keep_shown();
+        }
+    }
+
     auto screen_pos = ImGui::GetCursorScreenPos();
-    ImGui::Dummy({ dungeon_screen_size, dungeon_screen_size });
+    ImGui::Dummy({ (get_width() + 1 + Topology::odd_row_offset) * room_screen_size, (get_height() + 1) * room_screen_size });
     auto draw_list = ImGui::GetWindowDrawList();
 
     draw_grid(screen_pos, *draw_list);
     draw_dungeon(screen_pos, *draw_list);
 
+    LogEvent settings = get_settings_event();
+
     if (ImGui::Button("Reset dungeon"))
     {
         reset();
     }
-}
 
-void Dungeon::reset()
-{
-    m_selected_room = { 0,0 };
-    for (RoomRow& roomRow : m_rows)
+    // The engines and what they show need the board in a Bitboard.
+    if (has_bitboards())
     {
-        for (Room& room : roomRow)
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Chain deductions", &m_chain_deductions))
         {
-            room.reset();
+            derive_room_states();
         }
-    }
-}
 
-void Dungeon::draw_selected_room_details()
-{
-    ImGui::Text("Use this panel only to inspect/adjust");
-    ImGui::Text("rooms if you messed something up.");
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Complete", &m_complete_deductions))
+        {
+            derive_room_states();
+        }
 
-    ImGui::Separator();
+        if (ImGui::Checkbox("Probabilities", &m_show_probabilities))
+        {
+            update_probabilities(get_board_masks());
+        }
 
-    ImGui::Text("Position: %c:%d", m_selected_room.y + 65, m_selected_room.x);
-    auto& room = m_rows[m_selected_room.y][m_selected_room.x];
-    ImGui::Checkbox("Visited", &room.m_visited);
-    ImGui::Separator();
-    ImGui::Text("Neighbor");
+        if (is_estimating())
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled("estimating...");
+        }
 
-    for (int32 i = 0; i < a__Count; i++)
+        ImGui::SameLine();
+    }
+    else
     {
-        draw_neighbor_state(s_attribute_labels[i].c_str(), &room.m_neighbor_state[i]);
+        ImGui::TextDisabled(
+            "Over %d rooms only the local rules run: no chain or complete deductions, probabilities, provenance, contradiction checks, undo, sessions or logs",
+            bitboard_capacity);
     }
 
-    ImGui::Separator();
-    ImGui::Text("Room");
-    for (int32 i = 0; i < a__Count; i++)
+    bool beliefs_changed = ImGui::Checkbox("Noisy observations", &m_noisy_observations);
+    if (m_noisy_observations)
     {
-        draw_room_state(s_attribute_labels[i].c_str(), &room.m_room_state[i]);
+        beliefs_changed |= ImGui::SliderFloat("Error rate", &m_belief_settings.m_error_rate, 0.01f, 0.3f, "%.2f");
     }
-}
-
-void Dungeon::move_selection(
-    const ivec2& offset)
-{
-    m_selected_room.x = m_selected_room.x + offset.x;
-    m_selected_room.y = m_selected_room.y + offset.y;
-    if (m_selected_room.x >= dungeon_size) m_selected_room.x = 0;
-    if (m_selected_room.y >= dungeon_size) m_selected_room.y = 0;
-    if (m_selected_room.x < 0) m_selected_room.x = dungeon_size - 1;
-    if (m_selected_room.y < 0) m_selected_room.y = dungeon_size - 1;
-}
-
-void Dungeon::explore(
-    const bool pit,
-    const bool arrow,
-    const bool dragon)
-{
-    Room& room = m_rows[m_selected_room.y][m_selected_room.x];
-    room.m_visited = true;
-
-    if (room.m_room_state[a_Pit] != rs_Yes)
-        room.m_room_state[a_Pit] = rs_No;
 
-    if (room.m_room_state[a_Arrow] != rs_Yes)
-        room.m_room_state[a_Arrow] = rs_No;
+    if (beliefs_changed)
+    {
+        update_beliefs();
+    }
 
-    if (room.m_room_state[a_Dragon] != rs_Yes)
-        room.m_room_state[a_Dragon] = rs_No;
+    bool counts_changed = ImGui::Checkbox("Hazard counts", &m_use_hazard_counts);
+    if (m_use_hazard_counts)
+    {
+        for (int32 i = 0; i < a__Count; i++)
+        {
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(room_screen_size * 2.f);
+            if (ImGui::InputInt(s_attribute_labels[i].c_str(), &m_hazard_counts[i]))
+            {
+                m_hazard_counts[i] = std::clamp(m_hazard_counts[i], 0, m_rooms.get_room_count());
+                counts_changed = true;
+            }
+        }
+    }
 
-    if (room.m_neighbor_state[a_Pit] != ns_No)
+    if (counts_changed)
     {
-        room.m_neighbor_state[a_Pit] = pit ? ns_Yes : ns_No;
+        derive_room_states();
     }
 
-    if (room.m_neighbor_state[a_Arrow] != ns_No)
+    if (has_bitboards())
     {
-        room.m_neighbor_state[a_Arrow] = arrow ? ns_Yes : ns_No;
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Provenance", &m_track_provenance))
+        {
+            update_provenance(get_board_masks(), m_bitboard_engine.get_geometry().all());
+        }
     }
 
-    if (room.m_neighbor_state[a_Dragon] != ns_No)
+    if (m_log && !(get_settings_event() == settings))
     {
-        room.m_neighbor_state[a_Dragon] = dragon ? ns_Yes : ns_No;
+        m_log->add(get_settings_event());
     }
 
-    update_room_states();
-}
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        const Contradiction& contradiction = m_contradictions[i];
+        if (!contradiction.m_found)
+            continue;
 
-void Dungeon::found_a_pit()
-{
-    Room& room = m_rows[m_selected_room.y][m_selected_room.x];
-    room.m_visited = true;
-    room.m_room_state[a_Pit] = rs_Yes;
-    update_room_states();
-}
+        if (contradiction.m_observations.any() || contradiction.m_assumed.any())
+        {
+            std::string rooms = get_room_labels(contradiction.m_observations, get_width());
+            if (contradiction.m_assumed.any())
+            {
+                rooms += rooms.empty() ? "set by hand " : ", set by hand ";
+                rooms += get_room_labels(contradiction.m_assumed, get_width());
+            }
 
-void Dungeon::update_room_states()
-{
-    for (auto& row : m_rows)
-    {
-        for (auto& room : row)
+            ImGui::TextColored(
+                { 1.f, 0.25f, 0.25f, 1.f },
+                "%s rooms contradict each other: %s",
+                s_attribute_labels[i].c_str(),
+                rooms.c_str());
+        }
+        else
         {
-            room.update_room_state_no();
+            ImGui::TextColored(
+                { 1.f, 0.25f, 0.25f, 1.f },
+                "%s room states contradict each other, though the observations do not",
+                s_attribute_labels[i].c_str());
         }
     }
 
-    for (auto& row : m_rows)
+    for (int32 i = 0; i < a__Count; i++)
     {
-        for (auto& room : row)
+        if (m_complete_deductions && m_solver_stats.m_gave_up[i])
         {
-            room.update_room_state_maybe_yes();
+            ImGui::TextColored(
+                { 1.f, 0.75f, 0.25f, 1.f },
+                "%s: the complete solver ran out of decisions, some deductions may be missing",
+                s_attribute_labels[i].c_str());
         }
     }
 }
 
-const Room& Dungeon::get_room(
-    const ivec2& roomCoord) const
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::reset()
 {
-    int32 x = roomCoord.x;
-
-    while (x < 0)
-        x += dungeon_size;
+    DungeonSnapshot before = begin_step();
+    ivec2 selected_room = m_selected_room;
 
-    while (x >= dungeon_size)
-        x -= dungeon_size;
+    m_selected_room = { 0,0 };
+    m_dirty_rooms.clear();
+    m_changed_rooms.clear();
+    cancel_estimates();
+    m_rooms.reset();
 
-    int32 y = roomCoord.y;
+    for (BeliefPropagation<Topology>& engine : m_belief_engines)
+    {
+        engine.reset();
+    }
 
-    while (y < 0)
-        y += dungeon_size;
+    m_dragon_tracker.reset();
+    m_provenance_tracker.reset();
+    m_engine_masks_valid = false;
+    std::fill(m_observations.begin(), m_observations.end(), Observation{});
+    m_packed_observations = {};
+    std::fill(std::begin(m_assumed), std::end(m_assumed), Bitboard{});
+    std::fill(std::begin(m_contradictions), std::end(m_contradictions), Contradiction{});
+
+    // Derived as a new board with these settings is, which the hazard
+    // counts alone may decide. The local rules find nothing on it.
+    if (has_bitboards())
+    {
+        update_room_states();
+    }
 
-    while (y >= dungeon_size)
-        y -= dungeon_size;
+    end_step(before, selected_room);
 
-    return m_rows[y][x];
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_Reset });
+    }
 }
 
-void Dungeon::draw_dungeon(
-    const ImVec2 screen_pos,
-    ImDrawList& draw_list)
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::draw_selected_room_details()
 {
-    auto dungeon_pos = ImVec2{ screen_pos.x + room_screen_size, screen_pos.y + room_screen_size };
+    ImGui::Text("Use this panel only to inspect/adjust");
+    ImGui::Text("rooms if you messed something up.");
+
+    ImGui::Separator();
 
-    for (int y = 0; y < dungeon_size; y++)
+    ImGui::Text("Position: %s:%d", get_row_label(m_selected_room.y).c_str(), m_selected_room.x);
+    DungeonRoom room = get_room(m_selected_room);
+    bool visited = room.is_visited();
+    bool changed = ImGui::Checkbox("Visited", &visited);
+    ImGui::SameLine();
+    if (ImGui::Button("Retract observation"))
+    {
+        retract_observation(m_selected_room);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Neighbor");
+
+    NeighborState neighbor_state[a__Count];
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        neighbor_state[i] = room.get_neighbor_state((Attribute)i);
+        changed |= draw_neighbor_state(s_attribute_labels[i].c_str(), &neighbor_state[i]);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Room");
+    RoomState room_state[a__Count];
+    bool state_changed[a__Count]{};
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        room_state[i] = room.get_room_state((Attribute)i);
+        state_changed[i] = draw_room_state(s_attribute_labels[i].c_str(), &room_state[i]);
+        changed |= state_changed[i];
+    }
+
+    if (m_show_probabilities)
     {
-        float row_start_y = dungeon_pos.y + y * room_screen_size;
-        for (int x = 0; x < dungeon_size; x++)
+        ImGui::Separator();
+        for (int32 i = 0; i < a__Count; i++)
         {
-            ImVec2 room_pos{ dungeon_pos.x + x * room_screen_size, row_start_y };
-            ImU32 background_alpha = 96 + (x & 1) * 16 + (y & 1) * 16;
+            if (i > 0)
+            {
+                ImGui::SameLine();
+            }
+
+            const HazardEstimate& estimate = room.get_estimate((Attribute)i);
+            if (m_estimating[i])
+            {
+                ImGui::Text("%s estimating...", s_attribute_labels[i].c_str());
+            }
+            else if (estimate.m_half_width > 0.f)
+            {
+                ImGui::Text("%s %.0f%%(+-%.0f)", s_attribute_labels[i].c_str(), 100.f * estimate.m_probability, 100.f * estimate.m_half_width);
+            }
+            else
+            {
+                ImGui::Text("%s %.0f%%", s_attribute_labels[i].c_str(), 100.f * std::max(estimate.m_probability, 0.f));
+            }
+        }
+    }
 
-            auto& room = m_rows[y][x];
-            bool should_select = room.draw(background_alpha, room_pos, draw_list);
+    if (m_noisy_observations)
+    {
+        ImGui::Separator();
+        ImGui::Text(
+            "Belief: Pit %.0f%%  Arrow %.0f%%  Dragon %.0f%%",
+            100.f * room.get_estimate(a_Pit).m_belief,
+            100.f * room.get_estimate(a_Arrow).m_belief,
+            100.f * room.get_estimate(a_Dragon).m_belief);
+    }
 
-            if (should_select)
+    if (m_track_provenance && has_bitboards() && ImGui::TreeNode("Why"))
+    {
+        for (int32 i = 0; i < a__Count; i++)
+        {
+            RoomState state = room.get_room_state((Attribute)i);
+            if (state != rs_Yes && state != rs_No)
+                continue;
+
+            const Provenance& provenance = m_provenance_tracker.get_provenance(room.get_index(), (Attribute)i);
+            ImGui::Text(
+                "%s %s: %s",
+                s_attribute_labels[i].c_str(),
+                s_room_state_labels[state].c_str(),
+                s_deduction_rule_labels[provenance.m_rule].c_str());
+
+            if (provenance.m_sources.any())
             {
-                m_selected_room = { x, y };
+                ImGui::TextWrapped("  from %s", get_room_labels(provenance.m_sources, get_width()).c_str());
             }
         }
+        ImGui::TreePop();
     }
 
-    ImVec2 room_pos{ dungeon_pos.x + m_selected_room.x * room_screen_size, dungeon_pos.y + m_selected_room.y * room_screen_size };
-    ImVec2 room_pos_max{ room_pos.x + room_screen_size, room_pos.y + room_screen_size };
+    // Edits are observations like any other, a state set to Maybe or
+    // Unknown goes back to being derived.
+    if (changed)
+    {
+        Observation observation = get_observation(m_selected_room);
+        observation.m_visited = visited;
+        for (int32 i = 0; i < a__Count; i++)
+        {
+            observation.m_warning[i] = neighbor_state[i];
+            if (state_changed[i])
+            {
+                RoomState state = room_state[i];
+                observation.m_room_state[i] = state == rs_Yes || state == rs_No ? state : rs_Unknown;
+            }
+        }
 
-    draw_list.AddLine({ room_pos.x, room_pos.y }, { room_pos.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
-    draw_list.AddLine({ room_pos.x, room_pos.y }, { room_pos_max.x, room_pos.y }, IM_COL32(32, 32, 255, 255), 3.f);
-    draw_list.AddLine({ room_pos.x, room_pos_max.y }, { room_pos_max.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
-    draw_list.AddLine({ room_pos_max.x, room_pos.y }, { room_pos_max.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
+        edit_observation(m_selected_room, observation);
+    }
 }
 
-void Dungeon::draw_grid(
-    ImVec2 screen_pos,
-    ImDrawList& draw_list) const
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::move_selection(
+    const ivec2& offset)
 {
-    for (int i = 0; i <= dungeon_size + 1; i++)
+    ivec2 room_pos = { m_selected_room.x + offset.x, m_selected_room.y + offset.y };
+    if (room_pos.x >= get_width()) room_pos.x = 0;
+    if (room_pos.y >= get_height()) room_pos.y = 0;
+    if (room_pos.x < 0) room_pos.x = get_width() - 1;
+    if (room_pos.y < 0) room_pos.y = get_height() - 1;
+    select_room(room_pos);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::select_room(
+    const ivec2& room_pos)
+{
+    m_selected_room = room_pos;
+    if (m_log)
     {
-        float room_start_x = screen_pos.x + i * room_screen_size;
-        float room_start_y = screen_pos.y + i * room_screen_size;
+        m_log->add({ .m_type = le_Select, .m_room = (uint8)m_rooms.get_index(room_pos) });
+    }
+}
 
-        if (i > 0 && i <= dungeon_size)
-        {
-            char str[2] = { 0 };
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::explore(
+    const bool pit,
+    const bool arrow,
+    const bool dragon)
+{
+    DungeonSnapshot before = begin_step();
+    DungeonRoom room = get_room(m_selected_room);
+    room.set_visited(true);
 
-            str[0] = '0' + char(i - 1);
-            draw_list.AddText(nullptr, room_screen_size * 0.75f, { room_start_x + room_screen_size * 0.3f, screen_pos.y + room_screen_size * 0.15f }, IM_COL32_WHITE, str);
+    if (room.get_room_state(a_Pit) != rs_Yes)
+        room.set_room_state(a_Pit, rs_No);
 
-            str[0] = 'A' + char(i - 1);
-            draw_list.AddText(nullptr, room_screen_size * 0.75f, { screen_pos.x + room_screen_size * 0.3f, room_start_y + room_screen_size * 0.15f }, IM_COL32_WHITE, str);
-        }
+    if (room.get_room_state(a_Arrow) != rs_Yes)
+        room.set_room_state(a_Arrow, rs_No);
 
-        draw_list.AddLine(
-            { room_start_x, screen_pos.y },
-            { room_start_x, screen_pos.y + (dungeon_size + 1) * room_screen_size },
-            IM_COL32_WHITE);
+    if (room.get_room_state(a_Dragon) != rs_Yes)
+        room.set_room_state(a_Dragon, rs_No);
 
-        draw_list.AddLine(
-            { screen_pos.x, room_start_y },
-            { screen_pos.x + (dungeon_size + 1) * room_screen_size, room_start_y },
-            IM_COL32_WHITE);
+    if (room.get_neighbor_state(a_Pit) != ns_No)
+    {
+        room.set_neighbor_state(a_Pit, pit ? ns_Yes : ns_No);
     }
-}
+
+    if (room.get_neighbor_state(a_Arrow) != ns_No)
+    {
+        room.set_neighbor_state(a_Arrow, arrow ? ns_Yes : ns_No);
+    }
+
+    if (room.get_neighbor_state(a_Dragon) != ns_No)
+    {
+        room.set_neighbor_state(a_Dragon, dragon ? ns_Yes : ns_No);
+    }
+
+    Observation observation = m_observations[room.get_index()];
+    observation.m_visited = true;
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        observation.m_warning[i] = room.get_neighbor_state((Attribute)i);
+    }
+    set_observation(room.get_index(), observation);
+
+    if (has_bitboards())
+    {
+        m_dragon_tracker.observe(room.get_index(), room.get_neighbor_state(a_Dragon));
+    }
+
+    mark_room_dirty(m_selected_room);
+    propagate_dirty_rooms();
+
+    end_step(before, m_selected_room);
+
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_Explore, .m_warnings = (uint8)(pit | arrow << 1 | dragon << 2) });
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::found_a_pit()
+{
+    DungeonSnapshot before = begin_step();
+    DungeonRoom room = get_room(m_selected_room);
+    room.set_visited(true);
+    room.set_room_state(a_Pit, rs_Yes);
+
+    Observation observation = m_observations[room.get_index()];
+    observation.m_visited = true;
+    observation.m_room_state[a_Pit] = rs_Yes;
+    set_observation(room.get_index(), observation);
+
+    mark_room_dirty(m_selected_room);
+    propagate_dirty_rooms();
+
+    end_step(before, m_selected_room);
+
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_FoundAPit });
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::update_room_states()
+{
+    // Room by room with the local rules, the "No" pass over the whole
+    // board first as the "Maybe/Yes" pass reads rs_No two steps away.
+    if (!has_bitboards())
+    {
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            if (!m_rooms.is_wall(index))
+                DungeonRoom(m_rooms, index).update_room_state_no();
+        }
+
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            if (!m_rooms.is_wall(index))
+                DungeonRoom(m_rooms, index).update_room_state_maybe_yes();
+        }
+
+        update_beliefs();
+        return;
+    }
+
+    BoardMasks masks = get_board_masks();
+    m_bitboard_engine.update_room_states(masks);
+    m_dragon_tracker.rebuild(masks);
+    run_bitboard_engines(masks);
+    set_board_masks(masks);
+    update_probabilities(masks);
+    update_beliefs();
+    update_provenance(masks, m_bitboard_engine.get_geometry().all());
+    check_contradictions(masks);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::derive_room_states()
+{
+    for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+    {
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            m_rooms.set_room_state(index, (Attribute)a, get_observed_state(index, (Attribute)a));
+        }
+    }
+
+    update_room_states();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+const Observation& Dungeon<Width, Height, Topology>::get_observation(
+    const ivec2& room_pos) const
+{
+    return m_observations[m_rooms.get_index(room_pos)];
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::edit_observation(
+    const ivec2& room_pos,
+    const Observation& observation)
+{
+    int32 index = m_rooms.get_index(room_pos);
+    if (m_observations[index] == observation)
+        return;
+
+    DungeonSnapshot before = begin_step();
+    set_observation(index, observation);
+
+    m_rooms.set_visited(index, observation.m_visited);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        m_rooms.set_neighbor_state(index, (Attribute)a, observation.m_warning[a]);
+    }
+
+    // The states that rested on the old observation go back to what the
+    // observations alone say and are derived again with their neighbors.
+    // Without provenance nothing says which ones, so all of them do.
+    if (has_bitboards())
+    {
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            Bitboard stale = m_track_provenance ?
+                m_provenance_tracker.get_dependents(index, (Attribute)a) :
+                m_bitboard_engine.get_geometry().all();
+            stale.set(index);
+
+            while (stale.any())
+            {
+                int32 stale_index = stale.first();
+                stale.reset(stale_index);
+
+                m_rooms.set_room_state(stale_index, (Attribute)a, get_observed_state(stale_index, (Attribute)a));
+                mark_room_dirty(m_rooms.get_pos(stale_index));
+            }
+        }
+
+        m_dragon_tracker.rebuild(get_board_masks());
+    }
+    else
+    {
+        for (int32 stale_index = 0; stale_index < m_rooms.get_room_count(); stale_index++)
+        {
+            for (int32 a = 0; a < a__Count; a++)
+            {
+                m_rooms.set_room_state(stale_index, (Attribute)a, get_observed_state(stale_index, (Attribute)a));
+            }
+            mark_room_dirty(m_rooms.get_pos(stale_index));
+        }
+    }
+
+    propagate_dirty_rooms();
+
+    end_step(before, m_selected_room);
+
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_Edit, .m_room = (uint8)index, .m_observation = pack_observation(observation) });
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::retract_observation(
+    const ivec2& room_pos)
+{
+    edit_observation(room_pos, {});
+}
+
+template <int32 Width, int32 Height, typename Topology>
+RoomState Dungeon<Width, Height, Topology>::get_observed_state(
+    const int32 index,
+    const Attribute attrib) const
+{
+    const Observation& observation = m_observations[index];
+    if (observation.m_room_state[attrib] == rs_Yes || observation.m_room_state[attrib] == rs_No)
+        return observation.m_room_state[attrib];
+
+    return observation.m_visited ? rs_No : rs_Unknown;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::mark_room_dirty(
+    const ivec2& room_pos)
+{
+    m_dirty_rooms.push_back(room_pos);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::propagate_dirty_rooms()
+{
+    // Same result as update_room_states() on a board that was up to date
+    // before the dirty rooms changed, but only rooms whose rule inputs
+    // changed are evaluated:
+    // - the "No" pass of a room reads its own state and its neighbors'
+    //   warnings, so it reruns for dirty rooms and their neighbors,
+    // - the "Maybe/Yes" pass also reads rs_No two steps away, so it
+    //   additionally reruns around every room whose rs_No changed.
+    m_changed_rooms.clear();
+    m_worklist.clear();
+    if (++m_worklist_stamp == 0)
+    {
+        std::fill(m_worklist_stamps.begin(), m_worklist_stamps.end(), 0);
+        m_worklist_stamp = 1;
+    }
+
+    m_no_changed.clear();
+    for (const ivec2& dirty : m_dirty_rooms)
+    {
+        int32 index = m_rooms.get_index(dirty);
+        m_no_changed.push_back(index);
+
+        add_to_worklist(index);
+        for (int32 neighbor : m_rooms.get_neighbors(index))
+        {
+            add_to_worklist(neighbor);
+        }
+    }
+
+    m_dirty_rooms.clear();
+
+    size_t pass_no_count = m_worklist.size();
+    for (size_t i = 0; i < pass_no_count; i++)
+    {
+        const WorklistEntry& entry = m_worklist[i];
+        DungeonRoom room(m_rooms, entry.m_index);
+        room.update_room_state_no();
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            if ((entry.m_room_state[a] == rs_No) != (room.get_room_state((Attribute)a) == rs_No))
+            {
+                m_no_changed.push_back(entry.m_index);
+                break;
+            }
+        }
+    }
+
+    for (int32 index : m_no_changed)
+    {
+        for (int32 neighbor : m_rooms.get_neighbors(index))
+        {
+            if (m_rooms.is_wall(neighbor))
+                continue;
+
+            for (int32 second : m_rooms.get_neighbors(neighbor))
+            {
+                add_to_worklist(second);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_worklist.size(); i++)
+    {
+        const WorklistEntry& entry = m_worklist[i];
+        DungeonRoom room(m_rooms, entry.m_index);
+
+        // The "Maybe/Yes" pass expects rs_Maybe to be reset by the "No"
+        // pass first, which leaves rs_No alone for these rooms.
+        if (i >= pass_no_count)
+        {
+            room.update_room_state_no();
+        }
+
+        room.update_room_state_maybe_yes();
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            if (entry.m_room_state[a] != room.get_room_state((Attribute)a))
+            {
+                m_changed_rooms.push_back(room.get_pos());
+                break;
+            }
+        }
+    }
+
+    if (!has_bitboards())
+    {
+        if (m_noisy_observations)
+        {
+            update_beliefs();
+        }
+        return;
+    }
+
+    // The engines and the beliefs only read the board. When the local
+    // pass left it as the engines did last time, as walking through
+    // visited rooms does, they have nothing to add.
+    BoardMasks masks = get_board_masks();
+    if (!m_engine_masks_valid || !(masks == m_engine_masks))
+    {
+        run_bitboard_engines();
+        masks = get_board_masks();
+
+        if (m_noisy_observations)
+        {
+            update_beliefs();
+        }
+    }
+
+    // The rooms of the "No" pass, and those that changed in the end.
+    Bitboard explained;
+    for (size_t i = 0; i < pass_no_count; i++)
+    {
+        explained.set(m_worklist[i].m_index);
+    }
+
+    for (const ivec2& pos : m_changed_rooms)
+    {
+        explained.set(m_rooms.get_index(pos));
+    }
+
+    update_provenance(masks, explained);
+    check_contradictions(masks);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::run_bitboard_engines(
+    BoardMasks& masks)
+{
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        if (apply_hazard_count(masks, m_bitboard_engine.get_geometry(), (Attribute)a))
+        {
+            update_maybe_states(masks, m_bitboard_engine.get_geometry(), (Attribute)a);
+        }
+    }
+
+    if (m_dragon_tracker.apply(masks))
+    {
+        update_maybe_states(masks, m_bitboard_engine.get_geometry(), a_Dragon);
+    }
+
+    if (m_chain_deductions)
+    {
+        m_fixpoint_stats = m_fixpoint_engine.run(masks, fixpoint_budget);
+    }
+
+    // Without the solver nothing is known to be inconsistent, and the
+    // snapshots must not keep what an earlier run found.
+    m_solver_stats = m_complete_deductions ? m_entailment_solver.run(masks) : SolverStats{};
+
+    // Running them again on their own result changes nothing, unless
+    // the fixpoint engine ran out of time.
+    m_engine_masks = masks;
+    m_engine_masks_valid = !(m_chain_deductions && m_fixpoint_stats.m_budget_exhausted);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::run_bitboard_engines()
+{
+    BoardMasks masks = get_board_masks();
+    BoardMasks before = masks;
+    run_bitboard_engines(masks);
+
+    Bitboard changed;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 state = 0; state < rs__Count; state++)
+        {
+            changed |= masks.m_room_state[a][state] ^ before.m_room_state[a][state];
+        }
+    }
+
+    while (changed.any())
+    {
+        int32 index = changed.first();
+        changed.reset(index);
+
+        ivec2 pos = m_rooms.get_pos(index);
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            for (int32 state = 0; state < rs__Count; state++)
+            {
+                if (masks.m_room_state[a][state].test(index))
+                    m_rooms.set_room_state(index, (Attribute)a, (RoomState)state);
+            }
+        }
+
+        auto same_pos = [&pos](const ivec2& other) { return other.x == pos.x && other.y == pos.y; };
+        if (std::find_if(m_changed_rooms.begin(), m_changed_rooms.end(), same_pos) == m_changed_rooms.end())
+        {
+            m_changed_rooms.push_back(pos);
+        }
+    }
+
+    if (m_show_probabilities)
+    {
+        update_probabilities(masks);
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::update_probabilities(
+    const BoardMasks& masks)
+{
+    if (m_headless)
+        return;
+
+    cancel_estimates();
+
+    m_probability_stats = {};
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        // Hidden probabilities are only cleared, sampled ones until the
+        // estimate is ready.
+        float probabilities[bitboard_capacity];
+        bool consistent = false;
+        if (m_show_probabilities)
+        {
+            HazardProblem problem = m_entailment_solver.make_problem(masks, (Attribute)a);
+
+            ClauseComponents components;
+            Bitboard free;
+            split_components(problem.m_open, problem.m_clauses, components, free);
+
+            for (const auto& [rooms, clauses] : components)
+            {
+                m_estimating[a] |= rooms.count() > exact_component_limit;
+            }
+
+            if (m_estimating[a])
+            {
+                m_sampled_problems[a] = std::move(problem);
+            }
+            else
+            {
+                consistent = m_probability_engine.compute(problem, probabilities, m_probability_stats);
+            }
+        }
+
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            HazardEstimate& estimate = m_rooms.get_estimate(index, (Attribute)a);
+            estimate.m_probability = consistent ? probabilities[index] : -1.f;
+            estimate.m_half_width = 0.f;
+        }
+    }
+
+    poll_estimates();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::poll_estimates()
+{
+    if (!is_estimating())
+        return;
+
+    if (!m_monte_carlo)
+    {
+        m_monte_carlo = std::make_unique<MonteCarloEstimator>(m_sampler_threads);
+    }
+
+    // With a single sampler thread every estimate is done here.
+    while (true)
+    {
+        if (m_sampling >= 0)
+        {
+            MonteCarloResult result;
+            if (!m_monte_carlo->poll(result))
+                return;
+
+            for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+            {
+                HazardEstimate& estimate = m_rooms.get_estimate(index, (Attribute)m_sampling);
+                estimate.m_probability = result.m_consistent ? result.m_probability[index] : -1.f;
+                estimate.m_half_width = result.m_consistent ? result.m_half_width[index] : 0.f;
+            }
+
+            m_estimating[m_sampling] = false;
+            m_sampling = -1;
+        }
+
+        const bool* next = std::find(std::begin(m_estimating), std::end(m_estimating), true);
+        if (next == std::end(m_estimating))
+            break;
+
+        m_sampling = (int32)(next - std::begin(m_estimating));
+        m_monte_carlo->start(m_sampled_problems[m_sampling], monte_carlo_settings);
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::cancel_estimates()
+{
+    if (m_sampling >= 0)
+    {
+        m_monte_carlo->cancel();
+    }
+
+    m_sampling = -1;
+    std::fill(std::begin(m_estimating), std::end(m_estimating), false);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+bool Dungeon<Width, Height, Topology>::is_estimating() const
+{
+    return std::find(std::begin(m_estimating), std::end(m_estimating), true) != std::end(m_estimating);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::update_beliefs()
+{
+    if (m_headless)
+        return;
+
+    m_belief_stats = {};
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        BeliefPropagation<Topology>& engine = m_belief_engines[a];
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            m_rooms.get_estimate(index, (Attribute)a).m_belief = -1.f;
+            if (!m_noisy_observations)
+                continue;
+
+            // Only what the player entered counts as evidence, deduced
+            // states may rest on a wrong observation.
+            bool visited = m_rooms.is_visited(index);
+            engine.set_warning(index, visited ? m_rooms.get_neighbor_state(index, (Attribute)a) : ns_Unknown);
+            engine.set_room_evidence(
+                index,
+                !visited ? rs_Unknown :
+                m_rooms.get_room_state(index, (Attribute)a) == rs_Yes ? rs_Yes :
+                rs_No);
+        }
+
+        if (!m_noisy_observations)
+            continue;
+
+        m_belief_settings.m_prior = std::clamp((float)m_hazard_counts[a] / m_rooms.get_room_count(), 0.001f, 0.999f);
+        BeliefStats stats = engine.run(m_belief_settings);
+        m_belief_stats.m_sweeps += stats.m_sweeps;
+        m_belief_stats.m_max_change = std::max(m_belief_stats.m_max_change, stats.m_max_change);
+        m_belief_stats.m_converged = a == 0 ? stats.m_converged : m_belief_stats.m_converged && stats.m_converged;
+
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            m_rooms.get_estimate(index, (Attribute)a).m_belief = engine.get_belief(index);
+        }
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::update_provenance(
+    const BoardMasks& masks,
+    const Bitboard& rooms)
+{
+    if (m_track_provenance)
+    {
+        m_provenance_tracker.explain(masks, rooms, m_assumed);
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::check_contradictions(
+    const BoardMasks& masks)
+{
+    if (m_headless)
+        return;
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        // The complete solver notices conflicts the mask checks miss,
+        // when it runs.
+        bool conflict =
+            m_contradiction_detector.has_conflict(masks, (Attribute)a) ||
+            (m_complete_deductions && !m_solver_stats.m_consistent[a]);
+
+        m_contradictions[a] = conflict ?
+            m_contradiction_detector.find_minimal_conflict(masks, m_assumed[a], (Attribute)a) :
+            Contradiction{};
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::add_to_worklist(
+    const int32 index)
+{
+    if (m_rooms.is_wall(index))
+        return;
+
+    uint32& stamp = m_worklist_stamps[index];
+    if (stamp == m_worklist_stamp)
+        return;
+
+    stamp = m_worklist_stamp;
+
+    WorklistEntry entry{ index, {} };
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        entry.m_room_state[a] = m_rooms.get_room_state(index, (Attribute)a);
+    }
+    m_worklist.push_back(entry);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+Room<Width, Height, Topology> Dungeon<Width, Height, Topology>::get_room(
+    const ivec2& roomCoord)
+{
+    return Room(m_rooms, m_rooms.get_index(roomCoord));
+}
+
+template <int32 Width, int32 Height, typename Topology>
+BoardMasks Dungeon<Width, Height, Topology>::get_board_masks() const
+{
+    BoardMasks masks;
+    if (!has_bitboards())
+        return masks;
+
+    if (m_use_hazard_counts)
+    {
+        std::copy(std::begin(m_hazard_counts), std::end(m_hazard_counts), masks.m_hazard_count);
+    }
+
+    unpack_rooms(get_packed_rooms(), m_bitboard_engine.get_geometry().all(), masks);
+    return masks;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_board_masks(
+    const BoardMasks& masks)
+{
+    if (has_bitboards())
+    {
+        set_packed_rooms(pack_rooms(masks));
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+PackedRooms Dungeon<Width, Height, Topology>::get_packed_rooms() const
+{
+    PackedRooms rooms;
+    int32 room_count = m_rooms.get_room_count();
+    const uint64* visited = m_rooms.get_visited_words();
+    rooms.m_visited.m_words[0] = visited[0];
+    rooms.m_visited.m_words[1] = room_count > 64 ? visited[1] : 0;
+
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            rooms.m_neighbor_state[i][bit] = select_value_bit(m_rooms.get_neighbor_states((Attribute)i), bit, room_count);
+            rooms.m_room_state[i][bit] = select_value_bit(m_rooms.get_room_states((Attribute)i), bit, room_count);
+        }
+    }
+
+    return rooms;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_packed_rooms(
+    const PackedRooms& rooms)
+{
+    int32 room_count = m_rooms.get_room_count();
+    uint64* visited = m_rooms.get_visited_words();
+    visited[0] = rooms.m_visited.m_words[0];
+    if (room_count > 64)
+    {
+        visited[1] = rooms.m_visited.m_words[1];
+    }
+
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        store_values(rooms.m_neighbor_state[i], m_rooms.get_neighbor_states((Attribute)i), room_count);
+        store_values(rooms.m_room_state[i], m_rooms.get_room_states((Attribute)i), room_count);
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_room(
+    const int32 index,
+    const PackedRoom room)
+{
+    m_rooms.set_visited(index, room & 1);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        m_rooms.set_neighbor_state(index, (Attribute)a, (NeighborState)((room >> get_neighbor_state_shift((Attribute)a)) & 3));
+        m_rooms.set_room_state(index, (Attribute)a, (RoomState)((room >> get_room_state_shift((Attribute)a)) & 3));
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_observation(
+    const int32 index,
+    const Observation& observation)
+{
+    m_observations[index] = observation;
+    if (!has_bitboards())
+        return;
+
+    set_packed_room(m_packed_observations, index, pack_observation(observation));
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        bool assumed =
+            !observation.m_visited &&
+            (observation.m_room_state[a] == rs_Yes || observation.m_room_state[a] == rs_No);
+        if (assumed)
+            m_assumed[a].set(index);
+        else
+            m_assumed[a].reset(index);
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_inconsistent(
+    const uint8 inconsistent)
+{
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        m_solver_stats.m_consistent[a] = ((inconsistent >> a) & 1) == 0;
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+DungeonSnapshot Dungeon<Width, Height, Topology>::get_snapshot() const
+{
+    DungeonSnapshot snapshot;
+    if (!has_bitboards())
+        return snapshot;
+
+    snapshot.m_rooms = get_packed_rooms();
+    snapshot.m_observations = m_packed_observations;
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        snapshot.m_inconsistent |= (uint8)(!m_solver_stats.m_consistent[a] << a);
+    }
+
+    return snapshot;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::restore_snapshot(
+    const DungeonSnapshot& snapshot)
+{
+    if (!has_bitboards())
+        return;
+
+    set_packed_rooms(snapshot.m_rooms);
+    for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+    {
+        set_observation(index, unpack_observation(get_packed_room(snapshot.m_observations, index)));
+    }
+    set_inconsistent(snapshot.m_inconsistent);
+
+    m_changed_rooms.clear();
+    update_displays();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_headless(
+    const bool headless)
+{
+    bool shown = m_headless && !headless;
+    m_headless = headless;
+    if (headless)
+    {
+        cancel_estimates();
+    }
+
+    if (shown)
+    {
+        update_displays();
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::undo()
+{
+    apply_step(m_journal.undo(), 0);
+
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_Undo });
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::redo()
+{
+    apply_step(m_journal.redo(), 1);
+
+    if (m_log)
+    {
+        m_log->add({ .m_type = le_Redo });
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_log(
+    ObservationLog* log,
+    const bool starts_here)
+{
+    m_log = nullptr;
+    if (!log || !has_bitboards())
+        return;
+
+    if (!starts_here)
+    {
+        m_log = log;
+        m_log->add(get_settings_event());
+        return;
+    }
+
+    // A new log replays from an empty board with no history, so the board
+    // is entered again the same way, each observation an edit.
+    std::vector<Observation> observations = m_observations;
+    ivec2 selected_room = m_selected_room;
+    bool headless = m_headless;
+    set_headless(true);
+    reset();
+    clear_history();
+
+    m_log = log;
+    m_log->add(get_settings_event());
+    for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+    {
+        edit_observation(m_rooms.get_pos(index), observations[index]);
+    }
+    select_room(selected_room);
+    set_headless(headless);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::apply(
+    const LogEvent& event)
+{
+    switch (event.m_type)
+    {
+    case le_Select:
+        select_room(m_rooms.get_pos(event.m_room));
+        break;
+    case le_Explore:
+        explore(event.m_warnings & 1, (event.m_warnings >> 1) & 1, (event.m_warnings >> 2) & 1);
+        break;
+    case le_FoundAPit:
+        found_a_pit();
+        break;
+    case le_Reset:
+        reset();
+        break;
+    case le_Undo:
+        if (can_undo())
+            undo();
+        break;
+    case le_Redo:
+        if (can_redo())
+            redo();
+        break;
+    case le_Edit:
+        edit_observation(m_rooms.get_pos(event.m_room), unpack_observation(event.m_observation));
+        break;
+    case le_Settings:
+        apply_settings(event);
+        break;
+    default:
+        break;
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+int64 Dungeon<Width, Height, Topology>::replay(
+    ObservationLogReader& reader)
+{
+    bool same_board =
+        has_bitboards() &&
+        reader.get_topology() == Topology::id &&
+        reader.get_width() == get_width() &&
+        reader.get_height() == get_height();
+    if (!same_board)
+        return -1;
+
+    bool headless = m_headless;
+    set_headless(true);
+
+    int64 count = 0;
+    LogEvent event;
+    while (reader.next(event))
+    {
+        apply(event);
+        count++;
+    }
+
+    set_headless(headless);
+    return count;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+std::vector<uint8> Dungeon<Width, Height, Topology>::save_session() const
+{
+    if (!has_bitboards())
+        return {};
+
+    SessionWriter writer(Topology::id, get_width(), get_height());
+
+    writer.write(get_settings());
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        writer.write(m_hazard_counts[a]);
+    }
+    writer.write(m_belief_settings.m_error_rate);
+    writer.write((uint8)m_selected_room.x);
+    writer.write((uint8)m_selected_room.y);
+
+    DungeonSnapshot snapshot = get_snapshot();
+    write_rooms(writer, snapshot.m_rooms);
+    write_rooms(writer, snapshot.m_observations);
+    writer.write(snapshot.m_inconsistent);
+
+    m_journal.save(writer);
+    return writer.finish();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+bool Dungeon<Width, Height, Topology>::load_session(
+    const uint8* data,
+    const size_t size)
+{
+    if (!has_bitboards())
+        return false;
+
+    SessionReader reader(data, size, Topology::id, get_width(), get_height());
+
+    uint8 settings = 0;
+    int32 hazard_counts[a__Count]{};
+    float error_rate = 0.f;
+    uint8 x = 0;
+    uint8 y = 0;
+    reader.read(settings);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        reader.read(hazard_counts[a]);
+    }
+    reader.read(error_rate);
+    reader.read(x);
+    reader.read(y);
+
+    DungeonSnapshot snapshot;
+    read_rooms(reader, snapshot.m_rooms);
+    read_rooms(reader, snapshot.m_observations);
+    reader.read(snapshot.m_inconsistent);
+
+    const Bitboard& all = m_bitboard_engine.get_geometry().all();
+    bool valid =
+        reader.is_valid() &&
+        settings < (1 << 6) &&
+        error_rate >= 0.01f && error_rate <= 0.3f &&
+        x < get_width() && y < get_height() &&
+        is_valid(snapshot.m_rooms, all) &&
+        is_valid(snapshot.m_observations, all);
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        valid &= hazard_counts[a] >= 0 && hazard_counts[a] <= m_rooms.get_room_count();
+    }
+
+    Journal journal;
+    if (!valid || !journal.load(reader, get_width(), get_height()) || !reader.is_complete())
+        return false;
+
+    set_settings(settings);
+    std::copy(std::begin(hazard_counts), std::end(hazard_counts), m_hazard_counts);
+    m_belief_settings.m_error_rate = error_rate;
+    m_selected_room = { x, y };
+
+    restore_snapshot(snapshot);
+    m_journal = std::move(journal);
+    m_shown.clear();
+    return true;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::apply_step(
+    const JournalStep& step,
+    const int32 side)
+{
+    m_changed_rooms.clear();
+
+    // The changed rooms are explained again, with the rooms whose state
+    // rested on one of them. The rest keep their explanations.
+    Bitboard explained;
+    const RoomDelta* deltas = m_journal.get_deltas(step);
+    for (int32 i = 0; i < step.m_delta_count; i++)
+    {
+        const RoomDelta& delta = deltas[i];
+        set_room(delta.m_index, delta.m_room[side]);
+        set_observation(delta.m_index, unpack_observation(delta.m_observation[side]));
+        m_changed_rooms.push_back(m_rooms.get_pos(delta.m_index));
+
+        explained.set(delta.m_index);
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            explained |= m_provenance_tracker.get_dependents(delta.m_index, (Attribute)a);
+        }
+    }
+
+    m_selected_room = step.m_selected_room[side];
+    set_inconsistent(step.m_inconsistent[side]);
+    m_dirty_rooms.clear();
+
+    BoardMasks masks = get_board_masks();
+    m_dragon_tracker.rebuild(masks);
+    if (!restore_shown())
+    {
+        // The step kept what the solver found under the settings of its
+        // time, which may not be the current ones.
+        if (m_complete_deductions)
+        {
+            BoardMasks solved = masks;
+            m_solver_stats = m_entailment_solver.run(solved);
+        }
+        else
+        {
+            m_solver_stats = SolverStats{};
+        }
+
+        update_probabilities(masks);
+        update_beliefs();
+        check_contradictions(masks);
+        keep_shown();
+    }
+    update_provenance(masks, explained);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+uint8 Dungeon<Width, Height, Topology>::get_settings() const
+{
+    return
+        (uint8)m_chain_deductions |
+        (uint8)m_complete_deductions << 1 |
+        (uint8)m_show_probabilities << 2 |
+        (uint8)m_noisy_observations << 3 |
+        (uint8)m_use_hazard_counts << 4 |
+        (uint8)m_track_provenance << 5;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::set_settings(
+    const uint8 settings)
+{
+    m_chain_deductions = settings & 1;
+    m_complete_deductions = (settings >> 1) & 1;
+    m_show_probabilities = (settings >> 2) & 1;
+    m_noisy_observations = (settings >> 3) & 1;
+    m_use_hazard_counts = (settings >> 4) & 1;
+    m_track_provenance = (settings >> 5) & 1;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+LogEvent Dungeon<Width, Height, Topology>::get_settings_event() const
+{
+    LogEvent event{ .m_type = le_Settings, .m_settings = get_settings(), .m_error_rate = m_belief_settings.m_error_rate };
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        event.m_hazard_counts[a] = (uint8)m_hazard_counts[a];
+    }
+    return event;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::apply_settings(
+    const LogEvent& event)
+{
+    LogEvent before = get_settings_event();
+    uint8 changed = event.m_settings ^ before.m_settings;
+    bool counts_changed = !std::equal(std::begin(event.m_hazard_counts), std::end(event.m_hazard_counts), before.m_hazard_counts);
+
+    set_settings(event.m_settings);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        m_hazard_counts[a] = event.m_hazard_counts[a];
+    }
+    m_belief_settings.m_error_rate = event.m_error_rate;
+
+    // Chain, Complete and the hazard counts derive the rooms again, the
+    // rest only change what is shown.
+    if ((changed & (1 | 1 << 1 | 1 << 4)) || counts_changed)
+    {
+        derive_room_states();
+    }
+
+    if ((changed >> 2) & 1)
+    {
+        update_probabilities(get_board_masks());
+    }
+
+    if (((changed >> 3) & 1) || event.m_error_rate != before.m_error_rate)
+    {
+        update_beliefs();
+    }
+
+    if ((changed >> 5) & 1)
+    {
+        update_provenance(get_board_masks(), m_bitboard_engine.get_geometry().all());
+    }
+
+    if (m_log)
+    {
+        m_log->add(get_settings_event());
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+DungeonSnapshot Dungeon<Width, Height, Topology>::begin_step()
+{
+    if (!is_shown_kept())
+    {
+        keep_shown();
+    }
+    return get_snapshot();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::end_step(
+    const DungeonSnapshot& before,
+    const ivec2& selected_before)
+{
+    int32 position = m_journal.get_position();
+    m_journal.record(before, get_snapshot(), selected_before, m_selected_room);
+    if (m_journal.get_position() == position)
+        return;
+
+    // What was kept for the steps that were undone is gone with them.
+    m_shown.resize(std::min(m_shown.size(), (size_t)m_journal.get_position()));
+    keep_shown();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+bool Dungeon<Width, Height, Topology>::is_shown_kept() const
+{
+    int32 position = m_journal.get_position();
+    if (position >= (int32)m_shown.size())
+        return false;
+
+    const ShownState& shown = m_shown[position];
+    return
+        !shown.m_estimates.empty() &&
+        shown.m_settings == get_settings() &&
+        std::equal(std::begin(shown.m_hazard_counts), std::end(shown.m_hazard_counts), m_hazard_counts) &&
+        shown.m_error_rate == m_belief_settings.m_error_rate;
+}
+
+// Copies the estimates of every room, a few kilobytes a step on the
+// boards that have bitboards.
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::keep_shown()
+{
+    if (m_headless || !has_bitboards())
+        return;
+
+    int32 position = m_journal.get_position();
+    if (position >= (int32)m_shown.size())
+    {
+        m_shown.resize(position + 1);
+    }
+
+    // Kept once the sampled probabilities are ready.
+    ShownState& shown = m_shown[position];
+    if (is_estimating())
+    {
+        shown.m_estimates.clear();
+        return;
+    }
+
+    shown.m_settings = get_settings();
+    std::copy(std::begin(m_hazard_counts), std::end(m_hazard_counts), shown.m_hazard_counts);
+    shown.m_error_rate = m_belief_settings.m_error_rate;
+    shown.m_estimates.resize((size_t)a__Count * m_rooms.get_room_count());
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            shown.m_estimates[a * m_rooms.get_room_count() + index] = m_rooms.get_estimate(index, (Attribute)a);
+        }
+    }
+    std::copy(std::begin(m_contradictions), std::end(m_contradictions), shown.m_contradictions);
+    shown.m_probability_stats = m_probability_stats;
+    shown.m_belief_stats = m_belief_stats;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+bool Dungeon<Width, Height, Topology>::restore_shown()
+{
+    if (m_headless || !is_shown_kept())
+        return false;
+
+    // What was being sampled is for another board.
+    cancel_estimates();
+
+    const ShownState& shown = m_shown[m_journal.get_position()];
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 index = 0; index < m_rooms.get_room_count(); index++)
+        {
+            m_rooms.get_estimate(index, (Attribute)a) = shown.m_estimates[a * m_rooms.get_room_count() + index];
+        }
+    }
+    std::copy(std::begin(shown.m_contradictions), std::end(shown.m_contradictions), m_contradictions);
+    m_probability_stats = shown.m_probability_stats;
+    m_belief_stats = shown.m_belief_stats;
+    return true;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::update_displays()
+{
+    // Nothing is waiting to be derived, the room states are final.
+    m_dirty_rooms.clear();
+    if (!has_bitboards())
+    {
+        update_beliefs();
+        return;
+    }
+
+    BoardMasks masks = get_board_masks();
+    m_dragon_tracker.rebuild(masks);
+    update_probabilities(masks);
+    update_beliefs();
+    update_provenance(masks, m_bitboard_engine.get_geometry().all());
+    check_contradictions(masks);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::draw_dungeon(
+    const ImVec2 screen_pos,
+    ImDrawList& draw_list)
+{
+    auto dungeon_pos = ImVec2{ screen_pos.x + room_screen_size, screen_pos.y + room_screen_size };
+
+    for (int y = 0; y < get_height(); y++)
+    {
+        for (int x = 0; x < get_width(); x++)
+        {
+            ImVec2 room_pos = get_room_screen_pos(dungeon_pos, { x, y });
+            ImU32 background_alpha = 96 + (x & 1) * 16 + (y & 1) * 16;
+
+            bool should_select = get_room({ x, y }).draw(background_alpha, room_pos, draw_list);
+
+            if (should_select)
+            {
+                select_room({ x, y });
+            }
+        }
+    }
+
+    for (const ivec2& changed : m_changed_rooms)
+    {
+        ImVec2 changed_pos = get_room_screen_pos(dungeon_pos, changed);
+        draw_list.AddRect(changed_pos, { changed_pos.x + room_screen_size, changed_pos.y + room_screen_size }, IM_COL32(32, 255, 32, 160));
+    }
+
+    for (const Contradiction& contradiction : m_contradictions)
+    {
+        Bitboard rooms = contradiction.m_observations | contradiction.m_assumed;
+        while (rooms.any())
+        {
+            int32 index = rooms.first();
+            rooms.reset(index);
+
+            ImVec2 conflict_pos = get_room_screen_pos(dungeon_pos, m_rooms.get_pos(index));
+            draw_list.AddRect(conflict_pos, { conflict_pos.x + room_screen_size, conflict_pos.y + room_screen_size }, IM_COL32(255, 32, 32, 255), 0.f, 0, 2.f);
+        }
+    }
+
+    ImVec2 room_pos = get_room_screen_pos(dungeon_pos, m_selected_room);
+    ImVec2 room_pos_max{ room_pos.x + room_screen_size, room_pos.y + room_screen_size };
+
+    draw_list.AddLine({ room_pos.x, room_pos.y }, { room_pos.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
+    draw_list.AddLine({ room_pos.x, room_pos.y }, { room_pos_max.x, room_pos.y }, IM_COL32(32, 32, 255, 255), 3.f);
+    draw_list.AddLine({ room_pos.x, room_pos_max.y }, { room_pos_max.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
+    draw_list.AddLine({ room_pos_max.x, room_pos.y }, { room_pos_max.x, room_pos_max.y }, IM_COL32(32, 32, 255, 255), 3.f);
+}
+
+template <int32 Width, int32 Height, typename Topology>
+ImVec2 Dungeon<Width, Height, Topology>::get_room_screen_pos(
+    const ImVec2& dungeon_pos,
+    const ivec2& room_pos) const
+{
+    float x = room_pos.x + (room_pos.y & 1) * Topology::odd_row_offset;
+    return { dungeon_pos.x + x * room_screen_size, dungeon_pos.y + room_pos.y * room_screen_size };
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void Dungeon<Width, Height, Topology>::draw_grid(
+    ImVec2 screen_pos,
+    ImDrawList& draw_list) const
+{
+    int32 width = get_width();
+    int32 height = get_height();
+    for (int i = 0; i <= std::max(width, height) + 1; i++)
+    {
+        float room_start_x = screen_pos.x + i * room_screen_size;
+        float room_start_y = screen_pos.y + i * room_screen_size;
+
+        if (i > 0 && i <= width)
+        {
+            draw_list.AddText(nullptr, room_screen_size * 0.75f, { room_start_x + room_screen_size * 0.3f, screen_pos.y + room_screen_size * 0.15f }, IM_COL32_WHITE, std::to_string(i - 1).c_str());
+        }
+
+        // Past Z the labels take two letters, set smaller to fit.
+        if (i > 0 && i <= height)
+        {
+            std::string label = get_row_label(i - 1);
+            bool two_letters = label.size() > 1;
+            draw_list.AddText(nullptr, room_screen_size * (two_letters ? 0.5f : 0.75f), { screen_pos.x + room_screen_size * (two_letters ? 0.2f : 0.3f), room_start_y + room_screen_size * (two_letters ? 0.25f : 0.15f) }, IM_COL32_WHITE, label.c_str());
+        }
+
+        // Columns of a hex board do not line up.
+        if (i <= width + 1 && Topology::odd_row_offset == 0.f)
+        {
+            draw_list.AddLine(
+                { room_start_x, screen_pos.y },
+                { room_start_x, screen_pos.y + (height + 1) * room_screen_size },
+                IM_COL32_WHITE);
+        }
+
+        if (i <= height + 1)
+        {
+            draw_list.AddLine(
+                { screen_pos.x, room_start_y },
+                { screen_pos.x + (width + 1) * room_screen_size, room_start_y },
+                IM_COL32_WHITE);
+        }
+    }
+}
+
+template class Room<dungeon_size, dungeon_size, Torus>;
+template class Room<dynamic_size, dynamic_size, Torus>;
+template class Room<dungeon_size, dungeon_size, WalledGrid>;
+template class Room<dynamic_size, dynamic_size, WalledGrid>;
+template class Room<dungeon_size, dungeon_size, HexGrid>;
+template class Room<dynamic_size, dynamic_size, HexGrid>;
+template class Dungeon<dungeon_size, dungeon_size, Torus>;
+template class Dungeon<dynamic_size, dynamic_size, Torus>;
+template class Dungeon<dungeon_size, dungeon_size, WalledGrid>;
+template class Dungeon<dynamic_size, dynamic_size, WalledGrid>;
+template class Dungeon<dungeon_size, dungeon_size, HexGrid>;
+template class Dungeon<dynamic_size, dynamic_size, HexGrid>;
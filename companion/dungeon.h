@@ -2,117 +2,153 @@
 
 #include <vector>
 #include <array>
+#include <memory>
 #include "imgui.h"
-
-//////////////////////////////
-// POD Types
-//////////////////////////////
-
-using int32 = int32_t;
-using uint32 = uint32_t;
-
-struct ivec2
-{
-    int32 x;
-    int32 y;
-};
-
-//////////////////////////////
-// NeighborState
-//////////////////////////////
-
-enum NeighborState
-{
-    ns_Unknown,
-    ns_No,
-    ns_Yes,
-    ns__Count,
-};
-
-//////////////////////////////
-// RoomState
-//////////////////////////////
-
-enum RoomState
-{
-    rs_Unknown,
-    rs_Maybe,
-    rs_Yes,
-    rs_No,
-    rs__Count,
-};
-
-//////////////////////////////
-// Attribute
-//////////////////////////////
-
-enum Attribute
-{
-    a_Pit,
-    a_Arrow,
-    a_Dragon,
-    a__Count,
-};
+#include "dungeon_types.h"
+#include "room_store.h"
+#include "bitboard_engine.h"
+#include "fixpoint_engine.h"
+#include "entailment_solver.h"
+#include "probability_engine.h"
+#include "monte_carlo.h"
+#include "belief_propagation.h"
+#include "dragon_tracker.h"
+#include "provenance.h"
+#include "contradiction.h"
+#include "packed_rooms.h"
+#include "journal.h"
+#include "observation_log.h"
 
 //////////////////////////////
 // Room class
 //////////////////////////////
 
-class Room;
-
-using NeighborArray = std::array< const Room*, 4 >;
-
+// A handle to one room of a RoomStore, cheap to copy around. The rules
+// look at one room and its neighbors at a time, through the store's
+// neighbor table. A neighbor behind a wall is the store's wall slot,
+// which reads as a room known to be empty.
+template <int32 Width, int32 Height, typename Topology>
 class Room
 {
 public:
     Room(
-        const ivec2& pos);
+        RoomStore<Width, Height, Topology>& store,
+        const int32 index) :
+        m_store(&store),
+        m_index(index)
+    {
+    }
+
     void reset();
     void update_room_state_no();
     void update_room_state_maybe_yes();
     bool draw(
         ImU32 background_alpha,
         const ImVec2& room_pos,
-        ImDrawList& draw_list);
+        ImDrawList& draw_list) const;
 
-    bool m_visited;
-    NeighborState m_neighbor_state[a__Count];
-    RoomState m_room_state[a__Count];
+    ivec2 get_pos() const { return m_store->get_pos(m_index); }
+    int32 get_index() const { return m_index; }
 
-private:
-    ivec2 m_pos;
+    bool is_visited() const { return m_store->is_visited(m_index); }
+    void set_visited(
+        const bool visited) { m_store->set_visited(m_index, visited); }
 
-    NeighborArray get_neighbor_rooms() const;
     NeighborState get_neighbor_state(
+        const Attribute attrib) const { return m_store->get_neighbor_state(m_index, attrib); }
+    void set_neighbor_state(
+        const Attribute attrib,
+        const NeighborState state) { m_store->set_neighbor_state(m_index, attrib, state); }
+
+    RoomState get_room_state(
+        const Attribute attrib) const { return m_store->get_room_state(m_index, attrib); }
+    void set_room_state(
+        const Attribute attrib,
+        const RoomState state) { m_store->set_room_state(m_index, attrib, state); }
+
+    const HazardEstimate& get_estimate(
+        const Attribute attrib) const { return m_store->get_estimate(m_index, attrib); }
+
+private:
+    RoomStore<Width, Height, Topology>* m_store;
+    int32 m_index;
+
+    bool is_attr_visible(
         const Attribute attrib) const;
+    ImU32 get_attr_color(
+        const Attribute attrib) const;
+
     void update_room_state_attr_no(
         const Attribute attrib,
-        const NeighborArray& neighbor_rooms);
+        const NeighborArray<Topology>& neighbors);
 
-    int32 get_neighbor_attr_no_count(
+    // rs_No rooms around the given room.
+    int32 get_attr_no_count(
+        const int32 index,
         const Attribute attrib) const;
 
     void update_room_state_attr_maybe_yes(
         const Attribute attrib,
-        const NeighborArray& neighbor_rooms);
+        const NeighborArray<Topology>& neighbors);
+};
+
+//////////////////////////////
+// Observation
+//////////////////////////////
+
+// What was entered for one room. Every other room state is derived from
+// these, so they can be edited or taken back later.
+struct Observation
+{
+    bool m_visited = false;
+    NeighborState m_warning[a__Count]{ ns_Unknown, ns_Unknown, ns_Unknown };
+    RoomState m_room_state[a__Count]{ rs_Unknown, rs_Unknown, rs_Unknown };  // rs_Yes/rs_No found or set by hand
+
+    bool operator== (
+        const Observation& other) const = default;
 };
 
 //////////////////////////////
 // Dungeon class
 //////////////////////////////
 
-using RoomRow = std::vector<Room>;
-using RoomRows = std::vector<RoomRow>;
+using RoomList = std::vector<ivec2>;
 
+// Each dungeon owns its rooms and engines and shares nothing with other
+// dungeons, so independent boards can be analysed on separate threads.
+//
+// Dungeon<> is the handheld's board, with its dimensions known to the
+// compiler. Dungeon<dynamic_size, dynamic_size> takes them at run time
+// for other boards. A board whose size is known to the compiler fits in
+// a Bitboard. One sized at run time may not, and is then derived room by
+// room with the local rules alone: the engines, probabilities,
+// provenance and contradictions, the history, sessions and logs are all
+// left out. The Topology says how rooms connect, the rules and engines
+// follow it. Only the boards instantiated at the end of dungeon.cpp are
+// available.
+template <int32 Width = dungeon_size, int32 Height = Width, typename Topology = Torus>
 class Dungeon
 {
 public:
-    Dungeon();
+    static_assert(RoomStore<Width, Height, Topology>::is_dynamic || Width * Height <= bitboard_capacity);
+
+    using DungeonRoom = Room<Width, Height, Topology>;
+
+    // Probabilities of large warning groups are sampled on this many
+    // threads, 0 for one per core and 1 for the calling thread.
+    Dungeon(
+        const int32 sampler_threads = 0) requires (!RoomStore<Width, Height, Topology>::is_dynamic);
+    Dungeon(
+        const int32 width,
+        const int32 height,
+        const int32 sampler_threads = 0) requires (RoomStore<Width, Height, Topology>::is_dynamic);
     void draw();
     void reset();
     void draw_selected_room_details();
     void move_selection(
         const ivec2& offset);
+    void select_room(
+        const ivec2& room_pos);
     void explore(
         const bool pit,
         const bool arrow,
@@ -121,18 +157,262 @@ public:
     void found_a_pit();
     void update_room_states();
 
-    const Room& get_room(
-        const ivec2& roomCoord) const;
+    // Takes every room back to what the observations say and derives it
+    // again, for settings that take deductions away as well as add them.
+    void derive_room_states();
+
+    const Observation& get_observation(
+        const ivec2& room_pos) const;
+
+    // Replaces what was entered for a room. Only the room states that
+    // rested on the old observation are derived again.
+    void edit_observation(
+        const ivec2& room_pos,
+        const Observation& observation);
+    void retract_observation(
+        const ivec2& room_pos);
+
+    void mark_room_dirty(
+        const ivec2& room_pos);
+    void propagate_dirty_rooms();
+
+    // Rooms whose state changed during the last propagate_dirty_rooms().
+    const RoomList& get_changed_rooms() const { return m_changed_rooms; }
+    const FixpointStats& get_fixpoint_stats() const { return m_fixpoint_stats; }
+    const SolverStats& get_solver_stats() const { return m_solver_stats; }
+    const ProbabilityStats& get_probability_stats() const { return m_probability_stats; }
+    const BeliefStats& get_belief_stats() const { return m_belief_stats; }
+    const Contradiction& get_contradiction(
+        const Attribute attrib) const { return m_contradictions[attrib]; }
+
+    DungeonRoom get_room(
+        const ivec2& roomCoord);
+    int32 get_width() const { return m_rooms.get_width(); }
+    int32 get_height() const { return m_rooms.get_height(); }
+
+    // False for boards too big for a Bitboard, which have none of what
+    // is built on one.
+    bool has_bitboards() const
+    {
+        return !RoomStore<Width, Height, Topology>::is_dynamic || m_rooms.get_room_count() <= bitboard_capacity;
+    }
+
+    // Empty masks, and nothing set, without bitboards.
+    BoardMasks get_board_masks() const;
+    void set_board_masks(
+        const BoardMasks& masks);
+
+    // Restoring takes the room states as they were instead of deriving
+    // them again, then updates what is shown from them. Without bitboards
+    // snapshots are empty and restoring one does nothing.
+    DungeonSnapshot get_snapshot() const;
+    void restore_snapshot(
+        const DungeonSnapshot& snapshot);
+
+    // Steps back and forth through explore(), found_a_pit(), edited
+    // observations and reset(), putting back only the rooms each one
+    // changed, and what was shown when the board was last there with the
+    // same settings. Settings that derive the rooms again are not steps.
+    bool can_undo() const { return m_journal.can_undo(); }
+    bool can_redo() const { return m_journal.can_redo(); }
+    void undo();
+    void redo();
+
+    // Forgets the steps so far, for boards that play many games in a row.
+    void clear_history()
+    {
+        m_journal.clear();
+        m_shown.clear();
+    }
+
+    // The board with its settings, history and selection, in the session
+    // format. Loading leaves the board alone unless the session is for a
+    // board of this size and topology and reads back valid. Nothing is
+    // saved or loaded without bitboards.
+    std::vector<uint8> save_session() const;
+    bool load_session(
+        const uint8* data,
+        const size_t size);
+
+    // Leaves out what is only shown: probabilities, beliefs and
+    // contradictions, for boards replayed or simulated with nobody
+    // looking. The room states come out the same.
+    void set_headless(
+        const bool headless);
+
+    // The settings as they are, then every move, step, edit and settings
+    // change is added to the log from then on. A log that starts here
+    // replays from an empty board, so the board is entered again from
+    // one: its observations become edits and the only history it has.
+    // None when it is null or the board has no bitboards.
+    void set_log(
+        ObservationLog* log,
+        const bool starts_here);
+
+    // Does what the event says, as the player did.
+    void apply(
+        const LogEvent& event);
+
+    // Applies the events of the log until it ends or is damaged, returns
+    // how many. -1 when the log is for another board, or the board has
+    // no bitboards. What is only shown is updated once, at the end.
+    int64 replay(
+        ObservationLogReader& reader);
+
+    // Changes with every step the board takes, settings are saved along
+    // with the next one.
+    uint64 get_revision() const { return m_journal.get_revision(); }
 
 private:
 
-    RoomRows m_rows;
+    // The engines get a geometry without rooms when the board does not
+    // fit in a Bitboard.
+    Dungeon(
+        const int32 width,
+        const int32 height,
+        const BoardGeometry& geometry,
+        const int32 sampler_threads);
+
+    RoomStore<Width, Height, Topology> m_rooms;
+    std::vector<Observation> m_observations;
+    PackedRooms m_packed_observations;      // the same as planes, for snapshots
+    Bitboard m_assumed[a__Count];   // unvisited rooms with a state set by hand
+    BitboardEngine m_bitboard_engine;
+    DragonTracker m_dragon_tracker;
+    ProvenanceTracker m_provenance_tracker;
+    ContradictionDetector m_contradiction_detector;
+    Contradiction m_contradictions[a__Count];
+    FixpointEngine m_fixpoint_engine;
+    FixpointStats m_fixpoint_stats;
+    EntailmentSolver m_entailment_solver;
+    SolverStats m_solver_stats;
+    ProbabilityEngine m_probability_engine;
+    ProbabilityStats m_probability_stats;
+    int32 m_sampler_threads;
+    std::unique_ptr<MonteCarloEstimator> m_monte_carlo;
+    HazardProblem m_sampled_problems[a__Count];
+    bool m_estimating[a__Count]{};          // probabilities still being sampled
+    int32 m_sampling = -1;                  // the attribute on m_monte_carlo, -1 for none
+    std::vector<BeliefPropagation<Topology>> m_belief_engines;     // one per attribute
+    BeliefSettings m_belief_settings;
+    BeliefStats m_belief_stats;
+    bool m_chain_deductions = true;
+    bool m_complete_deductions = true;
+    bool m_show_probabilities = true;
+    bool m_noisy_observations = false;
+    bool m_use_hazard_counts = false;
+    bool m_track_provenance = true;
+    bool m_headless = false;
+    int32 m_hazard_counts[a__Count];
+    RoomList m_dirty_rooms;
+    RoomList m_changed_rooms;
+    Journal m_journal;
+    ObservationLog* m_log = nullptr;
+
+    // What was shown at one position of the journal, put back when the
+    // board steps there again. Only good for the settings it was worked
+    // out with.
+    struct ShownState
+    {
+        uint8 m_settings = 0;
+        int32 m_hazard_counts[a__Count]{};
+        float m_error_rate = 0.f;
+        std::vector<HazardEstimate> m_estimates;    // rooms of one attribute after the other, empty when not kept
+        Contradiction m_contradictions[a__Count];
+        ProbabilityStats m_probability_stats;
+        BeliefStats m_belief_stats;
+    };
+
+    std::vector<ShownState> m_shown;        // by journal position
+
+    struct WorklistEntry
+    {
+        int32 m_index;
+        RoomState m_room_state[a__Count];
+    };
+
+    std::vector<WorklistEntry> m_worklist;
+    std::vector<uint32> m_worklist_stamps;
+    uint32 m_worklist_stamp = 0;
+    std::vector<int32> m_no_changed;        // rooms whose rs_No changed, and the dirty rooms
+
+    BoardMasks m_engine_masks;              // the board as the engines last left it
+    bool m_engine_masks_valid = false;
+
+    PackedRooms get_packed_rooms() const;
+    void set_packed_rooms(
+        const PackedRooms& rooms);
+    void set_room(
+        const int32 index,
+        const PackedRoom room);
+    void set_observation(
+        const int32 index,
+        const Observation& observation);
+    void set_inconsistent(
+        const uint8 inconsistent);
+    void apply_step(
+        const JournalStep& step,
+        const int32 side);
+
+    // The settings as bits, in the session format.
+    uint8 get_settings() const;
+    void set_settings(
+        const uint8 settings);
+    LogEvent get_settings_event() const;
+
+    // Takes on the settings of the event and does what changing them in
+    // draw() does.
+    void apply_settings(
+        const LogEvent& event);
+
+    // The board before a step. What is shown for it is kept first, unless
+    // it already is for these settings.
+    DungeonSnapshot begin_step();
+    void end_step(
+        const DungeonSnapshot& before,
+        const ivec2& selected_before);
+    bool is_shown_kept() const;
+    void keep_shown();
+    bool restore_shown();
+
+    // What is shown from the room states, after they were put back. Every
+    // room is explained again, as what a state rests on depends on the
+    // order the rooms were decided in.
+    void update_displays();
+
+    RoomState get_observed_state(
+        const int32 index,
+        const Attribute attrib) const;
+    void add_to_worklist(
+        const int32 index);
+    void run_bitboard_engines();
+    void run_bitboard_engines(
+        BoardMasks& masks);
+    void update_probabilities(
+        const BoardMasks& masks);
+
+    // Sampled probabilities are shown once they are ready, one attribute
+    // after the other. draw() keeps them for undo when the last one is.
+    void poll_estimates();
+    void cancel_estimates();
+    bool is_estimating() const;
+    void update_beliefs();
+    void update_provenance(
+        const BoardMasks& masks,
+        const Bitboard& rooms);
+    void check_contradictions(
+        const BoardMasks& masks);
     ivec2 m_selected_room{ 0,0 };
 
     void draw_dungeon(
         const ImVec2 screen_pos,
         ImDrawList& draw_list);
 
+    // Odd rows of a hex board sit half a room to the right.
+    ImVec2 get_room_screen_pos(
+        const ImVec2& dungeon_pos,
+        const ivec2& room_pos) const;
+
     void draw_grid(
         ImVec2 screen_pos,
         ImDrawList& draw_list) const;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+//////////////////////////////
+// POD Types
+//////////////////////////////
+
+using uint8 = uint8_t;
+using uint16 = uint16_t;
+using int32 = int32_t;
+using uint32 = uint32_t;
+using int64 = int64_t;
+using uint64 = uint64_t;
+
+struct ivec2
+{
+    int32 x;
+    int32 y;
+};
+
+// Rooms per side of the handheld's board.
+constexpr int32 dungeon_size = 10;
+
+//////////////////////////////
+// NeighborState
+//////////////////////////////
+
+enum NeighborState
+{
+    ns_Unknown,
+    ns_No,
+    ns_Yes,
+    ns__Count,
+};
+
+//////////////////////////////
+// RoomState
+//////////////////////////////
+
+enum RoomState
+{
+    rs_Unknown,
+    rs_Maybe,
+    rs_Yes,
+    rs_No,
+    rs__Count,
+};
+
+//////////////////////////////
+// Attribute
+//////////////////////////////
+
+enum Attribute
+{
+    a_Pit,
+    a_Arrow,
+    a_Dragon,
+    a__Count,
+};
+
+// There is a single dragon, pits and arrows can occur several times.
+constexpr bool is_hazard_unique(
+    const Attribute attrib)
+{
+    return attrib == a_Dragon;
+}
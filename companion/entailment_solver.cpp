@@ -0,0 +1,324 @@
+#include "entailment_solver.h"
+
+void split_components(
+    const Bitboard& rooms,
+    const std::vector<Bitboard>& clauses,
+    ClauseComponents& components,
+    Bitboard& free)
+{
+    free = rooms;
+    std::vector<bool> assigned(clauses.size(), false);
+
+    for (size_t seed = 0; seed < clauses.size(); seed++)
+    {
+        if (assigned[seed])
+            continue;
+
+        Bitboard component_rooms = clauses[seed];
+        std::vector<Bitboard> component_clauses;
+        assigned[seed] = true;
+        component_clauses.push_back(clauses[seed]);
+
+        bool grown = true;
+        while (grown)
+        {
+            grown = false;
+            for (size_t i = seed + 1; i < clauses.size(); i++)
+            {
+                if (!assigned[i] && (clauses[i] & component_rooms).any())
+                {
+                    assigned[i] = true;
+                    component_rooms |= clauses[i];
+                    component_clauses.push_back(clauses[i]);
+                    grown = true;
+                }
+            }
+        }
+
+        free &= ~component_rooms;
+        components.push_back({ component_rooms, std::move(component_clauses) });
+    }
+}
+
+EntailmentSolver::EntailmentSolver(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+    for (int32 i = 0; i < m_geometry.room_count(); i++)
+    {
+        Bitboard room;
+        room.set(i);
+        m_room_neighbors[i] = m_geometry.neighbors_of(room);
+    }
+}
+
+SolverStats EntailmentSolver::run(
+    BoardMasks& masks)
+{
+    SolverStats stats;
+    m_decisions_left = solver_decision_budget;
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        Attribute attrib = (Attribute)i;
+        HazardProblem problem = make_problem(masks, attrib);
+
+        Bitboard forced_yes;
+        Bitboard forced_no;
+        bool consistent = solve_backbone(problem, forced_yes, forced_no, stats);
+        if (m_decisions_left < 0)
+        {
+            stats.m_gave_up[attrib] = true;
+            continue;
+        }
+
+        stats.m_consistent[attrib] = consistent;
+        if (!consistent)
+            continue;
+
+        move_to_state(masks.m_room_state[attrib], forced_yes, rs_Yes);
+        move_to_state(masks.m_room_state[attrib], forced_no, rs_No);
+        update_maybe_states(masks, m_geometry, attrib);
+    }
+
+    return stats;
+}
+
+HazardProblem EntailmentSolver::make_problem(
+    const BoardMasks& masks,
+    const Attribute attrib) const
+{
+    const Bitboard* room_state = masks.m_room_state[attrib];
+    const Bitboard* neighbor_state = masks.m_neighbor_state[attrib];
+
+    HazardProblem problem;
+    problem.m_yes = room_state[rs_Yes];
+    Bitboard no = room_state[rs_No] | m_geometry.neighbors_of(neighbor_state[ns_No]);
+    problem.m_open = m_geometry.all() & ~problem.m_yes & ~no;
+
+    // A known hazard next to a room without a warning can not be, an
+    // empty warning says so.
+    if ((problem.m_yes & no).any())
+    {
+        problem.m_clauses.push_back({});
+    }
+
+    Bitboard warnings = neighbor_state[ns_Yes];
+    while (warnings.any())
+    {
+        int32 index = warnings.first();
+        warnings.reset(index);
+
+        const Bitboard& neighbors = m_room_neighbors[index];
+        if ((neighbors & problem.m_yes).any())
+            continue;
+
+        problem.m_clauses.push_back(neighbors & problem.m_open);
+    }
+
+    int32 count = get_hazard_count(masks, attrib);
+    if (count >= 0)
+    {
+        problem.m_min_count = count;
+        problem.m_max_count = count;
+    }
+
+    return problem;
+}
+
+bool EntailmentSolver::is_satisfiable(
+    const HazardProblem& problem,
+    SolverStats& stats)
+{
+    m_decisions_left = solver_decision_budget;
+
+    Bitboard model;
+    return find_model(problem, problem.m_yes, {}, model, stats) || m_decisions_left < 0;
+}
+
+bool EntailmentSolver::solve_backbone(
+    const HazardProblem& problem,
+    Bitboard& forced_yes,
+    Bitboard& forced_no,
+    SolverStats& stats)
+{
+    Bitboard model;
+    if (!find_model(problem, problem.m_yes, {}, model, stats))
+        return false;
+
+    // Every model found shows both values it uses are possible. Any one of
+    // the rooms left free by a model could hold one more hazard as well.
+    Bitboard possible_yes = (model | m_model_free) & problem.m_open;
+    Bitboard possible_no = problem.m_open & ~model;
+
+    Bitboard rooms = problem.m_open;
+    while (rooms.any())
+    {
+        if (m_decisions_left < 0)
+        {
+            forced_yes = {};
+            forced_no = {};
+            return true;
+        }
+
+        int32 index = rooms.first();
+        rooms.reset(index);
+
+        Bitboard assumption;
+        assumption.set(index);
+
+        if (!possible_yes.test(index) &&
+            find_model(problem, problem.m_yes | assumption, {}, model, stats))
+        {
+            possible_yes |= (model | m_model_free) & problem.m_open;
+            possible_no |= problem.m_open & ~model;
+        }
+
+        if (!possible_no.test(index) &&
+            find_model(problem, problem.m_yes, assumption, model, stats))
+        {
+            possible_yes |= (model | m_model_free) & problem.m_open;
+            possible_no |= problem.m_open & ~model;
+        }
+    }
+
+    forced_yes = problem.m_open & ~possible_no;
+    forced_no = problem.m_open & ~possible_yes;
+    return true;
+}
+
+bool EntailmentSolver::find_model(
+    const HazardProblem& problem,
+    const Bitboard& yes,
+    const Bitboard& no,
+    Bitboard& model,
+    SolverStats& stats)
+{
+    stats.m_searches++;
+    return search(problem, yes, no, model, stats);
+}
+
+bool EntailmentSolver::search(
+    const HazardProblem& problem,
+    Bitboard yes,
+    Bitboard no,
+    Bitboard& model,
+    SolverStats& stats)
+{
+    if (!propagate(problem, yes, no))
+    {
+        stats.m_conflicts++;
+        return false;
+    }
+
+    // Branch on the unsatisfied warning with the fewest candidates.
+    Bitboard branch;
+    int32 branch_count = bitboard_capacity + 1;
+    for (const Bitboard& clause : problem.m_clauses)
+    {
+        if ((clause & yes).any())
+            continue;
+
+        Bitboard candidates = clause & ~no;
+        int32 count = candidates.count();
+        if (count < branch_count)
+        {
+            branch = candidates;
+            branch_count = count;
+        }
+    }
+
+    if (!branch.any())
+    {
+        // All warnings are explained, place the remaining hazards anywhere.
+        Bitboard free = problem.m_open & ~yes & ~no;
+        while (yes.count() < problem.m_min_count)
+        {
+            int32 index = free.first();
+            free.reset(index);
+            yes.set(index);
+        }
+
+        model = yes;
+        m_model_free = yes.count() < problem.m_max_count ? free : Bitboard{};
+        return true;
+    }
+
+    // Each branch excludes the rooms tried before it, so no placement is
+    // visited twice.
+    Bitboard branch_no = no;
+    while (branch.any())
+    {
+        // Out of decisions counts as no placement, which the callers
+        // tell from a real one by the budget.
+        if (--m_decisions_left < 0)
+            return false;
+
+        int32 index = branch.first();
+        branch.reset(index);
+        stats.m_decisions++;
+
+        Bitboard branch_yes = yes;
+        branch_yes.set(index);
+        if (search(problem, branch_yes, branch_no, model, stats))
+            return true;
+
+        branch_no.set(index);
+    }
+
+    return false;
+}
+
+bool EntailmentSolver::propagate(
+    const HazardProblem& problem,
+    Bitboard& yes,
+    Bitboard& no) const
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        int32 count = yes.count();
+        if (count > problem.m_max_count)
+            return false;
+
+        Bitboard free = problem.m_open & ~yes & ~no;
+        if (count == problem.m_max_count)
+        {
+            no |= free;
+            free = {};
+        }
+
+        if (count + free.count() < problem.m_min_count)
+            return false;
+
+        // Warnings whose candidates share no room need a hazard each.
+        Bitboard packed;
+        int32 needed = 0;
+        for (const Bitboard& clause : problem.m_clauses)
+        {
+            if ((clause & yes).any())
+                continue;
+
+            Bitboard candidates = clause & ~no;
+            if (!candidates.any())
+                return false;
+
+            if (candidates.count() == 1)
+            {
+                yes |= candidates;
+                changed = true;
+            }
+            else if (!(candidates & packed).any())
+            {
+                packed |= candidates;
+                needed++;
+            }
+        }
+
+        if (!changed && count + needed > problem.m_max_count)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include "bitboard_engine.h"
+
+//////////////////////////////
+// HazardProblem
+//////////////////////////////
+
+// Placements of one attribute's hazards that agree with the observations.
+struct HazardProblem
+{
+    Bitboard m_yes;                     // rooms known to hold the hazard
+    Bitboard m_open;                    // rooms that may or may not
+    std::vector<Bitboard> m_clauses;    // at least one hazard in each, subsets of m_open
+    int32 m_min_count = 0;              // hazards on the whole board
+    int32 m_max_count = bitboard_capacity;
+};
+
+// Warnings that share rooms, with the rooms they cover.
+using ClauseComponents = std::vector<std::pair<Bitboard, std::vector<Bitboard>>>;
+
+// Splits rooms into the rooms no warning mentions and groups of warnings
+// that share rooms.
+void split_components(
+    const Bitboard& rooms,
+    const std::vector<Bitboard>& clauses,
+    ClauseComponents& components,
+    Bitboard& free);
+
+//////////////////////////////
+// SolverStats
+//////////////////////////////
+
+// Decisions a run, or an is_satisfiable() query, may take in all. The
+// hardest observations of the 10x10 board with hazard counts take about
+// 2000, well under a millisecond.
+constexpr int32 solver_decision_budget = 4096;
+
+struct SolverStats
+{
+    int32 m_searches = 0;
+    int32 m_decisions = 0;
+    int32 m_conflicts = 0;
+    bool m_consistent[a__Count]{ true, true, true };
+    bool m_gave_up[a__Count]{};     // out of decisions, nothing forced
+};
+
+//////////////////////////////
+// EntailmentSolver class
+//////////////////////////////
+
+// Decides for every undecided room and attribute whether the observations
+// force the hazard in or out of it, by looking for a placement with the
+// opposite value. Placements are searched by backtracking over the rooms
+// of unsatisfied warnings with unit propagation on bitboards. Warnings
+// whose candidates share no room need a hazard each, which cuts off
+// branches that already hold too many for the hazard count.
+//
+// Once the decision budget runs out the attributes left are given up on
+// and keep what the other engines decided.
+class EntailmentSolver
+{
+public:
+    EntailmentSolver(
+        const BoardGeometry& geometry);
+
+    // Applies the forced states to the masks.
+    SolverStats run(
+        BoardMasks& masks);
+
+    HazardProblem make_problem(
+        const BoardMasks& masks,
+        const Attribute attrib) const;
+
+    // True if any placement fits the problem, or the decisions ran out
+    // before one was ruled out.
+    bool is_satisfiable(
+        const HazardProblem& problem,
+        SolverStats& stats);
+
+private:
+    BoardGeometry m_geometry;
+    Bitboard m_room_neighbors[bitboard_capacity];
+    Bitboard m_model_free;  // undecided rooms of the last model found
+    int32 m_decisions_left = solver_decision_budget;
+
+    // False if the problem has no solution at all. Stops short once the
+    // decisions run out, with nothing forced.
+    bool solve_backbone(
+        const HazardProblem& problem,
+        Bitboard& forced_yes,
+        Bitboard& forced_no,
+        SolverStats& stats);
+
+    bool find_model(
+        const HazardProblem& problem,
+        const Bitboard& yes,
+        const Bitboard& no,
+        Bitboard& model,
+        SolverStats& stats);
+
+    bool search(
+        const HazardProblem& problem,
+        Bitboard yes,
+        Bitboard no,
+        Bitboard& model,
+        SolverStats& stats);
+
+    bool propagate(
+        const HazardProblem& problem,
+        Bitboard& yes,
+        Bitboard& no) const;
+};
@@ -0,0 +1,132 @@
+#include "fixpoint_engine.h"
+
+FixpointEngine::FixpointEngine(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+    for (int32 i = 0; i < m_geometry.room_count(); i++)
+    {
+        Bitboard room;
+        room.set(i);
+        m_room_neighbors[i] = m_geometry.neighbors_of(room);
+    }
+}
+
+FixpointStats FixpointEngine::run(
+    BoardMasks& masks,
+    const std::chrono::microseconds budget) const
+{
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    FixpointStats stats;
+
+    // The deadline is checked after each attribute and within the subset
+    // rule, so a run stops a little after it rather than a sweep after.
+    bool changed = true;
+    while (changed && !stats.m_budget_exhausted)
+    {
+        changed = false;
+        stats.m_sweeps++;
+
+        for (int32 i = 0; i < a__Count && !stats.m_budget_exhausted; i++)
+        {
+            changed |= sweep_attr(masks, (Attribute)i, deadline, stats);
+
+            if (changed && std::chrono::steady_clock::now() >= deadline)
+            {
+                stats.m_budget_exhausted = true;
+            }
+        }
+    }
+
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        update_maybe_states(masks, m_geometry, (Attribute)i);
+    }
+
+    return stats;
+}
+
+bool FixpointEngine::sweep_attr(
+    BoardMasks& masks,
+    const Attribute attrib,
+    const std::chrono::steady_clock::time_point deadline,
+    FixpointStats& stats) const
+{
+    Bitboard* room_state = masks.m_room_state[attrib];
+    const Bitboard* neighbor_state = masks.m_neighbor_state[attrib];
+    const Bitboard& all = m_geometry.all();
+    bool changed = false;
+
+    Bitboard open = all & ~(room_state[rs_No] | room_state[rs_Yes]);
+    Bitboard no = open & m_geometry.neighbors_of(neighbor_state[ns_No]);
+    if (no.any())
+    {
+        move_to_state(room_state, no, rs_No);
+        stats.m_rule_firings[fr_No] += no.count();
+        changed = true;
+    }
+
+    if (apply_hazard_count(masks, m_geometry, attrib))
+    {
+        stats.m_rule_firings[fr_Count]++;
+        changed = true;
+    }
+
+    Bitboard candidates[bitboard_capacity];
+    int32 warning_count = 0;
+
+    Bitboard warnings = neighbor_state[ns_Yes];
+    while (warnings.any())
+    {
+        int32 index = warnings.first();
+        warnings.reset(index);
+
+        Bitboard candidate = m_room_neighbors[index] & ~room_state[rs_No];
+        if (candidate.count() == 1 && !(candidate & room_state[rs_Yes]).any())
+        {
+            move_to_state(room_state, candidate, rs_Yes);
+            stats.m_rule_firings[fr_Unit]++;
+            changed = true;
+        }
+
+        candidates[warning_count++] = candidate;
+    }
+
+    if (!is_hazard_unique(attrib))
+    {
+        return changed;
+    }
+
+    // The single hazard is in both neighborhoods, so when one candidate
+    // set is inside another the rest of the larger one is empty. The
+    // pairs are what takes time on a board full of warnings.
+    for (int32 i = 0; i < warning_count; i++)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            stats.m_budget_exhausted = true;
+            break;
+        }
+
+        const Bitboard& inner = candidates[i];
+        if (!inner.any())
+            continue;
+
+        for (int32 j = 0; j < warning_count; j++)
+        {
+            const Bitboard& outer = candidates[j];
+            if (i == j || (inner & ~outer).any())
+                continue;
+
+            Bitboard rest = outer & ~inner & ~room_state[rs_No];
+            if (rest.any())
+            {
+                move_to_state(room_state, rest, rs_No);
+                stats.m_rule_firings[fr_Subset]++;
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
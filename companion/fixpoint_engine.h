@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include "bitboard_engine.h"
+
+//////////////////////////////
+// FixpointRule
+//////////////////////////////
+
+enum FixpointRule
+{
+    fr_No,      // a room next to a room without a warning is empty
+    fr_Unit,    // a warning with a single candidate room left pins it down
+    fr_Subset,  // unique hazard, one warning's candidates inside another's
+    fr_Count,   // all hazards found, or just enough undecided rooms left
+    fr__Count,
+};
+
+//////////////////////////////
+// FixpointStats
+//////////////////////////////
+
+struct FixpointStats
+{
+    int32 m_sweeps = 0;
+    int32 m_rule_firings[fr__Count]{};
+    bool m_budget_exhausted = false;
+
+    int32 get_total_firings() const
+    {
+        int32 total = 0;
+        for (int32 firings : m_rule_firings)
+        {
+            total += firings;
+        }
+        return total;
+    }
+};
+
+//////////////////////////////
+// FixpointEngine class
+//////////////////////////////
+
+// Runs the local deduction rules over BoardMasks until nothing changes.
+// Every visited room with a warning is a constraint: at least one of its
+// neighbors holds the hazard. For hazards that exist only once (the
+// dragon) the warnings also say the hazard is in every warned
+// neighborhood, which is what the subset rule exploits. Known hazard
+// totals are checked with a popcount each sweep.
+//
+// Dungeon applies the DragonTracker first, which already rules out every
+// room outside all warned neighborhoods, so there the subset rule never
+// fires. It only matters to the engine run on its own.
+class FixpointEngine
+{
+public:
+    FixpointEngine(
+        const BoardGeometry& geometry);
+
+    FixpointStats run(
+        BoardMasks& masks,
+        const std::chrono::microseconds budget) const;
+
+private:
+    BoardGeometry m_geometry;
+    Bitboard m_room_neighbors[bitboard_capacity];
+
+    bool sweep_attr(
+        BoardMasks& masks,
+        const Attribute attrib,
+        const std::chrono::steady_clock::time_point deadline,
+        FixpointStats& stats) const;
+};
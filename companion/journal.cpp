@@ -0,0 +1,169 @@
+#include <cassert>
+#include "journal.h"
+
+void Journal::record(
+    const DungeonSnapshot& before,
+    const DungeonSnapshot& after,
+    const ivec2& selected_before,
+    const ivec2& selected_after)
+{
+    Bitboard changed =
+        get_changed_rooms(before.m_rooms, after.m_rooms) |
+        get_changed_rooms(before.m_observations, after.m_observations);
+
+    if (!changed.any() && before.m_inconsistent == after.m_inconsistent)
+        return;
+
+    if (can_redo())
+    {
+        m_deltas.resize(m_steps[m_position].m_first_delta);
+        m_steps.resize(m_position);
+    }
+
+    JournalStep step{
+        (int32)m_deltas.size(),
+        0,
+        { selected_before, selected_after },
+        { before.m_inconsistent, after.m_inconsistent } };
+    while (changed.any())
+    {
+        int32 index = changed.first();
+        changed.reset(index);
+
+        m_deltas.push_back({
+            (uint8)index,
+            { get_packed_room(before.m_rooms, index), get_packed_room(after.m_rooms, index) },
+            { get_packed_room(before.m_observations, index), get_packed_room(after.m_observations, index) } });
+        step.m_delta_count++;
+    }
+
+    m_steps.push_back(step);
+    m_position++;
+    m_revision++;
+}
+
+void Journal::clear()
+{
+    m_steps.clear();
+    m_deltas.clear();
+    m_position = 0;
+    m_revision++;
+}
+
+const JournalStep& Journal::undo()
+{
+    assert(can_undo());
+    m_revision++;
+    return m_steps[--m_position];
+}
+
+const JournalStep& Journal::redo()
+{
+    assert(can_redo());
+    m_revision++;
+    return m_steps[m_position++];
+}
+
+void Journal::save(
+    SessionWriter& writer) const
+{
+    writer.write((int32)m_steps.size());
+    writer.write((int32)m_deltas.size());
+    writer.write(m_position);
+
+    for (const JournalStep& step : m_steps)
+    {
+        writer.write(step.m_delta_count);
+        for (const ivec2& selected_room : step.m_selected_room)
+        {
+            writer.write((uint8)selected_room.x);
+            writer.write((uint8)selected_room.y);
+        }
+        writer.write(step.m_inconsistent[0]);
+        writer.write(step.m_inconsistent[1]);
+    }
+
+    for (const RoomDelta& delta : m_deltas)
+    {
+        writer.write(delta.m_index);
+        writer.write(delta.m_room[0]);
+        writer.write(delta.m_room[1]);
+        writer.write(delta.m_observation[0]);
+        writer.write(delta.m_observation[1]);
+    }
+}
+
+bool Journal::load(
+    SessionReader& reader,
+    const int32 width,
+    const int32 height)
+{
+    int32 step_count = 0;
+    int32 delta_count = 0;
+    int32 position = 0;
+    reader.read(step_count);
+    reader.read(delta_count);
+    reader.read(position);
+
+    // Counts are checked against what is left before anything is sized
+    // from them.
+    if (!reader.is_valid() ||
+        step_count < 0 || delta_count < 0 || position < 0 || position > step_count ||
+        !reader.has_bytes((size_t)step_count * 10 + (size_t)delta_count * 9))
+        return false;
+
+    std::vector<JournalStep> steps(step_count);
+    int32 first_delta = 0;
+    for (JournalStep& step : steps)
+    {
+        reader.read(step.m_delta_count);
+        for (ivec2& selected_room : step.m_selected_room)
+        {
+            uint8 x = 0;
+            uint8 y = 0;
+            reader.read(x);
+            reader.read(y);
+            if (x >= width || y >= height)
+                return false;
+
+            selected_room = { x, y };
+        }
+        reader.read(step.m_inconsistent[0]);
+        reader.read(step.m_inconsistent[1]);
+
+        if (step.m_delta_count < 0 || step.m_delta_count > delta_count - first_delta)
+            return false;
+
+        step.m_first_delta = first_delta;
+        first_delta += step.m_delta_count;
+    }
+
+    if (first_delta != delta_count)
+        return false;
+
+    std::vector<RoomDelta> deltas(delta_count);
+    for (RoomDelta& delta : deltas)
+    {
+        reader.read(delta.m_index);
+        reader.read(delta.m_room[0]);
+        reader.read(delta.m_room[1]);
+        reader.read(delta.m_observation[0]);
+        reader.read(delta.m_observation[1]);
+
+        bool valid =
+            delta.m_index < width * height &&
+            is_valid(delta.m_room[0]) && is_valid(delta.m_room[1]) &&
+            is_valid(delta.m_observation[0]) && is_valid(delta.m_observation[1]);
+        if (!valid)
+            return false;
+    }
+
+    if (!reader.is_valid())
+        return false;
+
+    m_steps = std::move(steps);
+    m_deltas = std::move(deltas);
+    m_position = position;
+    m_revision++;
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include "packed_rooms.h"
+#include "session.h"
+
+//////////////////////////////
+// RoomDelta
+//////////////////////////////
+
+// One room changed by a journal step, its packed fields before and after.
+struct RoomDelta
+{
+    uint8 m_index;
+    PackedRoom m_room[2];           // derived states, before and after
+    PackedRoom m_observation[2];    // what was entered, before and after
+};
+
+//////////////////////////////
+// JournalStep
+//////////////////////////////
+
+struct JournalStep
+{
+    int32 m_first_delta;
+    int32 m_delta_count;
+    ivec2 m_selected_room[2];       // the selection before and after
+    uint8 m_inconsistent[2];        // DungeonSnapshot::m_inconsistent, before and after
+};
+
+//////////////////////////////
+// Journal class
+//////////////////////////////
+
+// Undo history of a board as per-room deltas. A step keeps only the
+// rooms it changed, found by comparing the snapshots around it word by
+// word, so recording and stepping cost O(changed rooms) and a whole game
+// fits in a few kilobytes.
+//
+// Recording after an undo drops the steps that were undone.
+class Journal
+{
+public:
+    // Nothing is recorded when the snapshots are the same.
+    void record(
+        const DungeonSnapshot& before,
+        const DungeonSnapshot& after,
+        const ivec2& selected_before,
+        const ivec2& selected_after);
+
+    void clear();
+
+    bool can_undo() const { return m_position > 0; }
+    bool can_redo() const { return m_position < (int32)m_steps.size(); }
+
+    // Moves one step back or forward. The step's deltas are then applied
+    // with their before or after values.
+    const JournalStep& undo();
+    const JournalStep& redo();
+
+    const RoomDelta* get_deltas(
+        const JournalStep& step) const { return m_deltas.data() + step.m_first_delta; }
+
+    int32 get_position() const { return m_position; }
+    int32 get_step_count() const { return (int32)m_steps.size(); }
+
+    // Changes with every step recorded, undone or redone.
+    uint64 get_revision() const { return m_revision; }
+
+    void save(
+        SessionWriter& writer) const;
+
+    // Leaves the journal alone unless all of it reads back valid.
+    bool load(
+        SessionReader& reader,
+        const int32 width,
+        const int32 height);
+
+private:
+    std::vector<JournalStep> m_steps;
+    std::vector<RoomDelta> m_deltas;
+    int32 m_position = 0;           // steps applied
+    uint64 m_revision = 0;
+};
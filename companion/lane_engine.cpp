@@ -0,0 +1,250 @@
+#include "lane_engine.h"
+
+//////////////////////////////
+// LaneRoom
+//////////////////////////////
+
+inline LaneRegister load_room(
+    const LaneRoom& room)
+{
+    return load_register(room.m_words);
+}
+
+inline void store_room(
+    LaneRoom& room,
+    const LaneRegister value)
+{
+    store_register(room.m_words, value);
+}
+
+//////////////////////////////
+// LaneBoard
+//////////////////////////////
+
+Bitboard LaneBoard::get_lane(
+    const int32 lane) const
+{
+    Bitboard board;
+    for (int32 index = 0; index < bitboard_capacity; index++)
+    {
+        if (m_rooms[index].test(lane))
+            board.set(index);
+    }
+    return board;
+}
+
+void LaneBoard::set_lane(
+    const int32 lane,
+    const Bitboard& board)
+{
+    for (int32 index = 0; index < bitboard_capacity; index++)
+    {
+        m_rooms[index].set(lane, board.test(index));
+    }
+}
+
+//////////////////////////////
+// LaneMasks
+//////////////////////////////
+
+BoardMasks LaneMasks::get_lane(
+    const int32 lane) const
+{
+    BoardMasks masks;
+    masks.m_visited = m_visited.get_lane(lane);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 state = 0; state < ns__Count; state++)
+        {
+            masks.m_neighbor_state[a][state] = m_neighbor_state[a][state].get_lane(lane);
+        }
+
+        for (int32 state = 0; state < rs__Count; state++)
+        {
+            masks.m_room_state[a][state] = m_room_state[a][state].get_lane(lane);
+        }
+    }
+    return masks;
+}
+
+void LaneMasks::set_lane(
+    const int32 lane,
+    const BoardMasks& masks)
+{
+    m_visited.set_lane(lane, masks.m_visited);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 state = 0; state < ns__Count; state++)
+        {
+            m_neighbor_state[a][state].set_lane(lane, masks.m_neighbor_state[a][state]);
+        }
+
+        for (int32 state = 0; state < rs__Count; state++)
+        {
+            m_room_state[a][state].set_lane(lane, masks.m_room_state[a][state]);
+        }
+    }
+}
+
+void LaneMasks::get_room_states(
+    const int32 lane,
+    const int32 index,
+    BoardMasks& masks) const
+{
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 state = 0; state < rs__Count; state++)
+        {
+            if (m_room_state[a][state].m_rooms[index].test(lane))
+                masks.m_room_state[a][state].set(index);
+            else
+                masks.m_room_state[a][state].reset(index);
+        }
+    }
+}
+
+void LaneMasks::set_room(
+    const int32 lane,
+    const int32 index,
+    const BoardMasks& masks)
+{
+    m_visited.m_rooms[index].set(lane, masks.m_visited.test(index));
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 state = 0; state < ns__Count; state++)
+        {
+            m_neighbor_state[a][state].m_rooms[index].set(lane, masks.m_neighbor_state[a][state].test(index));
+        }
+
+        for (int32 state = 0; state < rs__Count; state++)
+        {
+            m_room_state[a][state].m_rooms[index].set(lane, masks.m_room_state[a][state].test(index));
+        }
+    }
+}
+
+//////////////////////////////
+// LaneEngine
+//////////////////////////////
+
+LaneEngine::LaneEngine(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+    for (int32 index = 0; index < m_geometry.room_count(); index++)
+    {
+        m_neighbor_count[index] = 0;
+        for (int32 d = 0; d < m_geometry.direction_count(); d++)
+        {
+            int32 neighbor = m_geometry.get_neighbor(index, d);
+            if (neighbor != m_geometry.room_count())
+                m_neighbors[index][m_neighbor_count[index]++] = neighbor;
+        }
+    }
+}
+
+void LaneEngine::update_room_states(
+    LaneMasks& masks) const
+{
+    LaneBoard changed;
+    update_rooms(masks, changed);
+}
+
+int32 LaneEngine::run_to_fixpoint(
+    LaneMasks& masks,
+    LaneBoard& changed) const
+{
+    changed = {};
+
+    int32 passes = 1;
+    while (update_rooms(masks, changed))
+    {
+        passes++;
+    }
+    return passes;
+}
+
+bool LaneEngine::update_rooms(
+    LaneMasks& masks,
+    LaneBoard& changed) const
+{
+    // The same passes as BitboardEngine::update_room_states_attr(), for
+    // each attribute, with the neighbors of a room read one by one where
+    // BitboardEngine shifts whole boards.
+    const int32 room_count = m_geometry.room_count();
+    const LaneRegister ones = register_ones();
+    LaneRegister decided = register_zero();
+    LaneRegister sure[bitboard_capacity];
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        LaneBoard* room_state = masks.m_room_state[a];
+        const LaneBoard& warning = masks.m_neighbor_state[a][ns_Yes];
+        const LaneBoard& no_warning = masks.m_neighbor_state[a][ns_No];
+
+        // An open room next to a room without a warning is empty.
+        for (int32 index = 0; index < room_count; index++)
+        {
+            LaneRegister next_to_no = register_zero();
+            for (int32 k = 0; k < m_neighbor_count[index]; k++)
+            {
+                next_to_no = register_or(next_to_no, load_room(no_warning.m_rooms[m_neighbors[index][k]]));
+            }
+
+            LaneRegister state_no = load_room(room_state[rs_No].m_rooms[index]);
+            LaneRegister state_yes = load_room(room_state[rs_Yes].m_rooms[index]);
+            LaneRegister no = register_and(register_andnot(next_to_no, state_no), register_andnot(ones, state_yes));
+            store_room(room_state[rs_No].m_rooms[index], register_or(state_no, no));
+            store_room(changed.m_rooms[index], register_or(load_room(changed.m_rooms[index]), no));
+            decided = register_or(decided, no);
+        }
+
+        // A warning with a single neighbor that is not empty pins it down.
+        for (int32 index = 0; index < room_count; index++)
+        {
+            LaneRegister once = register_zero();
+            LaneRegister more = register_zero();
+            for (int32 k = 0; k < m_neighbor_count[index]; k++)
+            {
+                LaneRegister possible = register_andnot(ones, load_room(room_state[rs_No].m_rooms[m_neighbors[index][k]]));
+                more = register_or(more, register_and(once, possible));
+                once = register_or(once, possible);
+            }
+            sure[index] = register_and(load_room(warning.m_rooms[index]), register_andnot(once, more));
+        }
+
+        // A room is a hazard when the first warned neighbor pins it down,
+        // and may be one next to any warning.
+        for (int32 index = 0; index < room_count; index++)
+        {
+            LaneRegister yes = register_zero();
+            LaneRegister seen = register_zero();
+            for (int32 k = 0; k < m_neighbor_count[index]; k++)
+            {
+                int32 neighbor = m_neighbors[index][k];
+                LaneRegister has_warning = load_room(warning.m_rooms[neighbor]);
+                yes = register_or(yes, register_and(register_andnot(has_warning, seen), sure[neighbor]));
+                seen = register_or(seen, has_warning);
+            }
+
+            LaneRegister state_yes = load_room(room_state[rs_Yes].m_rooms[index]);
+            LaneRegister open = register_andnot(ones, register_or(load_room(room_state[rs_No].m_rooms[index]), state_yes));
+            LaneRegister maybe_before = load_room(room_state[rs_Maybe].m_rooms[index]);
+            LaneRegister unknown_before = load_room(room_state[rs_Unknown].m_rooms[index]);
+
+            yes = register_and(open, yes);
+            LaneRegister maybe = register_andnot(register_and(open, seen), yes);
+            LaneRegister unknown = register_andnot(open, seen);
+            store_room(room_state[rs_Yes].m_rooms[index], register_or(state_yes, yes));
+            store_room(room_state[rs_Maybe].m_rooms[index], maybe);
+            store_room(room_state[rs_Unknown].m_rooms[index], unknown);
+
+            LaneRegister changed_states = register_or(
+                yes,
+                register_or(register_xor(maybe, maybe_before), register_xor(unknown, unknown_before)));
+            store_room(changed.m_rooms[index], register_or(load_room(changed.m_rooms[index]), changed_states));
+            decided = register_or(decided, yes);
+        }
+    }
+    return !register_is_zero(decided);
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "bitboard_engine.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//////////////////////////////
+// LaneRegister
+//////////////////////////////
+
+#if defined(__AVX512F__)
+
+using LaneRegister = __m512i;
+constexpr int32 register_words = 8;
+
+inline LaneRegister register_zero() { return _mm512_setzero_si512(); }
+inline LaneRegister register_ones() { return _mm512_set1_epi64(-1); }
+inline LaneRegister load_register(const uint64* words) { return _mm512_load_si512(words); }
+inline void store_register(uint64* words, const LaneRegister value) { _mm512_store_si512(words, value); }
+inline LaneRegister register_and(const LaneRegister a, const LaneRegister b) { return _mm512_and_si512(a, b); }
+inline LaneRegister register_or(const LaneRegister a, const LaneRegister b) { return _mm512_or_si512(a, b); }
+inline LaneRegister register_xor(const LaneRegister a, const LaneRegister b) { return _mm512_xor_si512(a, b); }
+inline LaneRegister register_andnot(const LaneRegister a, const LaneRegister b) { return _mm512_andnot_si512(b, a); }
+inline bool register_is_zero(const LaneRegister a) { return _mm512_test_epi64_mask(a, a) == 0; }
+
+#elif defined(__AVX2__)
+
+using LaneRegister = __m256i;
+constexpr int32 register_words = 4;
+
+inline LaneRegister register_zero() { return _mm256_setzero_si256(); }
+inline LaneRegister register_ones() { return _mm256_set1_epi64x(-1); }
+inline LaneRegister load_register(const uint64* words) { return _mm256_load_si256((const __m256i*)words); }
+inline void store_register(uint64* words, const LaneRegister value) { _mm256_store_si256((__m256i*)words, value); }
+inline LaneRegister register_and(const LaneRegister a, const LaneRegister b) { return _mm256_and_si256(a, b); }
+inline LaneRegister register_or(const LaneRegister a, const LaneRegister b) { return _mm256_or_si256(a, b); }
+inline LaneRegister register_xor(const LaneRegister a, const LaneRegister b) { return _mm256_xor_si256(a, b); }
+inline LaneRegister register_andnot(const LaneRegister a, const LaneRegister b) { return _mm256_andnot_si256(b, a); }
+inline bool register_is_zero(const LaneRegister a) { return _mm256_testz_si256(a, a) != 0; }
+
+#else
+
+using LaneRegister = uint64;
+constexpr int32 register_words = 1;
+
+inline LaneRegister register_zero() { return 0; }
+inline LaneRegister register_ones() { return ~0ull; }
+inline LaneRegister load_register(const uint64* words) { return *words; }
+inline void store_register(uint64* words, const LaneRegister value) { *words = value; }
+inline LaneRegister register_and(const LaneRegister a, const LaneRegister b) { return a & b; }
+inline LaneRegister register_or(const LaneRegister a, const LaneRegister b) { return a | b; }
+inline LaneRegister register_xor(const LaneRegister a, const LaneRegister b) { return a ^ b; }
+inline LaneRegister register_andnot(const LaneRegister a, const LaneRegister b) { return a & ~b; }
+inline bool register_is_zero(const LaneRegister a) { return a == 0; }
+
+#endif
+
+// Independent boards bit-sliced side by side: each room holds one bit
+// per lane, so that a single instruction moves the same room of every
+// lane in a register. The registers are picked at compile time: AVX-512
+// holds 512 lanes, AVX2 256, and without either a plain word holds 64.
+constexpr int32 lane_count = 64 * register_words;
+
+//////////////////////////////
+// LaneRoom
+//////////////////////////////
+
+// One room of every lane, a bit each, in one register.
+struct alignas(sizeof(uint64) * register_words) LaneRoom
+{
+    uint64 m_words[register_words]{};
+
+    bool test(
+        const int32 lane) const
+    {
+        return (m_words[lane / 64] >> (lane % 64)) & 1;
+    }
+
+    void set(
+        const int32 lane,
+        const bool value)
+    {
+        uint64 bit = 1ull << (lane % 64);
+        m_words[lane / 64] = value ? m_words[lane / 64] | bit : m_words[lane / 64] & ~bit;
+    }
+};
+
+//////////////////////////////
+// LaneBoard
+//////////////////////////////
+
+// A Bitboard per lane, room by room.
+struct LaneBoard
+{
+    LaneRoom m_rooms[bitboard_capacity];
+
+    Bitboard get_lane(
+        const int32 lane) const;
+    void set_lane(
+        const int32 lane,
+        const Bitboard& board);
+};
+
+//////////////////////////////
+// LaneMasks
+//////////////////////////////
+
+// BoardMasks of every lane. Hazard counts are not used by the lane
+// rules and are left out.
+struct LaneMasks
+{
+    LaneBoard m_visited;
+    LaneBoard m_neighbor_state[a__Count][ns__Count];
+    LaneBoard m_room_state[a__Count][rs__Count];
+
+    BoardMasks get_lane(
+        const int32 lane) const;
+    void set_lane(
+        const int32 lane,
+        const BoardMasks& masks);
+
+    // A room at a time, for boards that change a few rooms per step. The
+    // rules only change room states, so only those are read back.
+    void get_room_states(
+        const int32 lane,
+        const int32 index,
+        BoardMasks& masks) const;
+    void set_room(
+        const int32 lane,
+        const int32 index,
+        const BoardMasks& masks);
+};
+
+//////////////////////////////
+// LaneEngine class
+//////////////////////////////
+
+// BitboardEngine over all lanes at once, every lane on the same board
+// geometry. The rules go room by room, reading the neighbors' registers,
+// so each instruction decides a room for lane_count boards. Lane by lane
+// the room states come out exactly as BitboardEngine leaves them.
+class LaneEngine
+{
+public:
+    LaneEngine(
+        const BoardGeometry& geometry);
+
+    void update_room_states(
+        LaneMasks& masks) const;
+
+    // Runs the rules again until no lane changes. A room whose state
+    // changed in a lane gets that lane's bit in changed. Returns the
+    // passes it took.
+    int32 run_to_fixpoint(
+        LaneMasks& masks,
+        LaneBoard& changed) const;
+
+    const BoardGeometry& get_geometry() const { return m_geometry; }
+
+private:
+    BoardGeometry m_geometry;
+
+    // Each room's neighbors in direction order, walls left out.
+    int32 m_neighbors[bitboard_capacity][max_direction_count];
+    int32 m_neighbor_count[bitboard_capacity];
+
+    // Returns true if any room got decided.
+    bool update_rooms(
+        LaneMasks& masks,
+        LaneBoard& changed) const;
+};
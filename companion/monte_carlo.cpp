@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "monte_carlo.h"
+
+// Samples drawn between two looks at the shared totals.
+constexpr int32 samples_per_batch = 512;
+
+// Redraws of one warning group before the whole placement is given up.
+constexpr int32 max_component_redraws = 4096;
+
+void MonteCarloEstimator::Totals::add(
+    const Totals& other)
+{
+    m_weight += other.m_weight;
+    m_weight_squared += other.m_weight_squared;
+    for (int32 i = 0; i < bitboard_capacity; i++)
+    {
+        m_hits[i] += other.m_hits[i];
+        m_hits_squared[i] += other.m_hits_squared[i];
+    }
+    m_samples += other.m_samples;
+    m_attempts += other.m_attempts;
+}
+
+MonteCarloEstimator::MonteCarloEstimator(
+    const int32 thread_count)
+{
+    int32 count = thread_count > 0 ?
+        thread_count :
+        std::max(1, (int32)std::thread::hardware_concurrency());
+
+    if (count == 1)
+        return;
+
+    for (int32 i = 0; i < count; i++)
+    {
+        m_threads.emplace_back(&MonteCarloEstimator::worker, this, i);
+    }
+}
+
+MonteCarloEstimator::~MonteCarloEstimator()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_shutdown = true;
+        m_stop = true;
+    }
+    m_work_ready.notify_all();
+
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+MonteCarloResult MonteCarloEstimator::estimate(
+    const HazardProblem& problem,
+    const MonteCarloSettings& settings)
+{
+    start(problem, settings);
+
+    MonteCarloResult result;
+    {
+        std::unique_lock lock(m_mutex);
+        m_work_done.wait(lock, [this] { return m_busy_threads == 0; });
+    }
+    poll(result);
+    return result;
+}
+
+void MonteCarloEstimator::start(
+    const HazardProblem& problem,
+    const MonteCarloSettings& settings)
+{
+    cancel();
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_problem = problem;
+        m_settings = settings;
+        m_deadline = std::chrono::steady_clock::now() + settings.m_time_limit;
+        m_stop = false;
+        m_totals = {};
+        m_pending = true;
+
+        // A problem with a warning no room can explain has no placement.
+        for (const Bitboard& clause : m_problem.m_clauses)
+        {
+            if (!clause.any())
+                return;
+        }
+
+        m_busy_threads = (int32)m_threads.size();
+        m_generation++;
+    }
+
+    if (m_threads.empty())
+    {
+        sample_job(0, m_generation);
+    }
+    else
+    {
+        m_work_ready.notify_all();
+    }
+}
+
+bool MonteCarloEstimator::poll(
+    MonteCarloResult& result)
+{
+    std::lock_guard lock(m_mutex);
+    if (!m_pending || m_busy_threads > 0)
+        return false;
+
+    m_pending = false;
+    result = make_result();
+    return true;
+}
+
+void MonteCarloEstimator::cancel()
+{
+    std::unique_lock lock(m_mutex);
+    m_stop = true;
+    m_work_done.wait(lock, [this] { return m_busy_threads == 0; });
+    m_pending = false;
+}
+
+MonteCarloResult MonteCarloEstimator::make_result() const
+{
+    MonteCarloResult result;
+    result.m_samples = m_totals.m_samples;
+    result.m_attempts = m_totals.m_attempts;
+    result.m_consistent = m_totals.m_samples > 0;
+    result.m_converged = result.m_consistent && has_converged(m_totals, m_settings);
+
+    for (int32 i = 0; i < bitboard_capacity; i++)
+    {
+        if (m_problem.m_yes.test(i))
+        {
+            result.m_probability[i] = 1.f;
+        }
+        else if (m_problem.m_open.test(i) && result.m_consistent)
+        {
+            double weight = m_totals.m_weight;
+            double probability = m_totals.m_hits[i] / weight;
+            double variance =
+                (m_totals.m_hits_squared[i] * (1.0 - 2.0 * probability) +
+                probability * probability * m_totals.m_weight_squared) / (weight * weight);
+
+            result.m_probability[i] = (float)probability;
+            result.m_half_width[i] = m_settings.m_z * (float)std::sqrt(std::max(variance, 0.0));
+        }
+    }
+
+    return result;
+}
+
+void MonteCarloEstimator::worker(
+    const int32 thread_index)
+{
+    uint64 seen_generation = 0;
+    while (true)
+    {
+        uint64 generation;
+        {
+            std::unique_lock lock(m_mutex);
+            m_work_ready.wait(lock, [this, seen_generation] { return m_shutdown || m_generation != seen_generation; });
+            if (m_shutdown)
+                return;
+
+            generation = seen_generation = m_generation;
+        }
+
+        sample_job(thread_index, generation);
+
+        std::lock_guard lock(m_mutex);
+        if (--m_busy_threads == 0)
+        {
+            m_work_done.notify_all();
+        }
+    }
+}
+
+void MonteCarloEstimator::sample_job(
+    const int32 thread_index,
+    const uint64 generation)
+{
+    const HazardProblem& problem = m_problem;
+    const MonteCarloSettings& settings = m_settings;
+
+    // Independent stream per thread and per job.
+    std::seed_seq seed{ (uint32)settings.m_seed, (uint32)(settings.m_seed >> 32), (uint32)thread_index, (uint32)generation };
+    std::mt19937_64 rng(seed);
+
+    ClauseComponents components;
+    Bitboard free;
+    split_components(problem.m_open, problem.m_clauses, components, free);
+
+    int32 known = problem.m_yes.count();
+    int32 open_count = problem.m_open.count();
+    int32 min_placed = problem.m_min_count - known;
+    int32 max_placed = problem.m_max_count - known;
+
+    double density = 0.5;
+    if (min_placed > 0 || max_placed < open_count)
+    {
+        double target = 0.5 * (std::max(min_placed, 0) + std::min(max_placed, open_count));
+        density = std::clamp(target / std::max(open_count, 1), 0.001, 0.999);
+    }
+
+    // Warned rooms hold hazards far more often than the rest, so they are
+    // drawn with a density that gets their warnings explained quickly.
+    double warned_density = std::max(density, 1.0 / 3.0);
+    if (density == 0.5)
+        warned_density = 0.5;
+
+    // A placement's weight is the inverse of the chance it was drawn with,
+    // ((1 - p) / p)^k for each group of rooms, up to a constant factor.
+    double log_ratio = std::log((1.0 - density) / density);
+    double warned_log_ratio = std::log((1.0 - warned_density) / warned_density);
+    double reference = density * free.count();
+
+    auto draw = [&rng](const Bitboard& rooms, const double probability)
+    {
+        if (probability == 0.5)
+            return Bitboard{ { rng(), rng() } } & rooms;
+
+        // Four 16-bit uniforms per 64-bit draw.
+        uint64 threshold = (uint64)(probability * 65536.0);
+        Bitboard drawn;
+        Bitboard remaining = rooms;
+        uint64 bits = 0;
+        int32 bits_left = 0;
+        while (remaining.any())
+        {
+            int32 index = remaining.first();
+            remaining.reset(index);
+
+            if (bits_left == 0)
+            {
+                bits = rng();
+                bits_left = 4;
+            }
+
+            if ((bits & 0xFFFF) < threshold)
+                drawn.set(index);
+
+            bits >>= 16;
+            bits_left--;
+        }
+        return drawn;
+    };
+
+    auto explains_all = [](const Bitboard& placed, const std::vector<Bitboard>& clauses)
+    {
+        for (const Bitboard& clause : clauses)
+        {
+            if (!(clause & placed).any())
+                return false;
+        }
+        return true;
+    };
+
+    Totals local;
+    while (!m_stop)
+    {
+        for (int32 sample = 0; sample < samples_per_batch; sample++)
+        {
+            local.m_attempts++;
+
+            Bitboard placed = draw(free, density);
+            int32 free_count = placed.count();
+            bool valid = true;
+            for (const auto& [rooms, clauses] : components)
+            {
+                int32 redraws = 0;
+                Bitboard drawn = draw(rooms, warned_density);
+                while (!explains_all(drawn, clauses) && ++redraws < max_component_redraws)
+                {
+                    drawn = draw(rooms, warned_density);
+                }
+
+                valid &= redraws < max_component_redraws;
+                placed |= drawn;
+            }
+
+            int32 count = placed.count();
+            if (!valid || count < min_placed || count > max_placed)
+                continue;
+
+            double weight = std::exp(
+                (free_count - reference) * log_ratio +
+                (count - free_count) * warned_log_ratio);
+            local.m_samples++;
+            local.m_weight += weight;
+            local.m_weight_squared += weight * weight;
+            while (placed.any())
+            {
+                int32 index = placed.first();
+                placed.reset(index);
+                local.m_hits[index] += weight;
+                local.m_hits_squared[index] += weight * weight;
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        m_totals.add(local);
+        local = {};
+
+        if (has_converged(m_totals, settings) ||
+            m_totals.m_attempts >= settings.m_max_samples ||
+            std::chrono::steady_clock::now() >= m_deadline)
+        {
+            m_stop = true;
+        }
+    }
+}
+
+bool MonteCarloEstimator::has_converged(
+    const Totals& totals,
+    const MonteCarloSettings& settings) const
+{
+    if (totals.m_samples == 0)
+        return false;
+
+    double weight = totals.m_weight;
+    double effective_samples = weight * weight / totals.m_weight_squared;
+    if (effective_samples < settings.m_min_samples)
+        return false;
+
+    double limit = settings.m_tolerance / settings.m_z;
+    limit *= limit;
+
+    Bitboard rooms = m_problem.m_open;
+    while (rooms.any())
+    {
+        int32 index = rooms.first();
+        rooms.reset(index);
+
+        double probability = totals.m_hits[index] / weight;
+        double variance =
+            (totals.m_hits_squared[index] * (1.0 - 2.0 * probability) +
+            probability * probability * totals.m_weight_squared) / (weight * weight);
+        if (variance > limit)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "entailment_solver.h"
+
+//////////////////////////////
+// MonteCarloSettings
+//////////////////////////////
+
+struct MonteCarloSettings
+{
+    float m_tolerance = 0.02f;              // widest confidence half-width accepted
+    float m_z = 1.96f;                      // 95% confidence
+    int64 m_min_samples = 2000;             // effective samples before stopping
+    int64 m_max_samples = 4000000;
+    std::chrono::milliseconds m_time_limit{ 50 };
+    uint64 m_seed = 0x5EED;
+};
+
+//////////////////////////////
+// MonteCarloResult
+//////////////////////////////
+
+struct MonteCarloResult
+{
+    float m_probability[bitboard_capacity]{};
+    float m_half_width[bitboard_capacity]{};
+    int64 m_samples = 0;
+    int64 m_attempts = 0;
+    bool m_consistent = false;              // at least one placement was found
+    bool m_converged = false;
+};
+
+//////////////////////////////
+// MonteCarloEstimator class
+//////////////////////////////
+
+// Estimates hazard probabilities by sampling placements that agree with a
+// HazardProblem, for boards where exact counting gets too expensive.
+//
+// Undecided rooms get a hazard with probability p. Each group of warnings
+// that shares rooms is redrawn until all of its warnings are explained,
+// and the whole placement is rejected if its hazard count is out of
+// bounds. The kept placements are weighted back to a uniform choice
+// among all placements. p is 1/2 (weights all 1) unless the hazard count
+// is bounded, in which case it follows the expected density so the count
+// check rarely fails.
+//
+// Sampling runs on a pool of worker threads, each with its own random
+// stream, and stops once every room's confidence interval is narrower
+// than the tolerance. With a single thread it runs on the caller's,
+// for boards that are already analysed one per thread.
+//
+// start() hands the sampling to the pool and returns at once, so the
+// caller can keep drawing and poll() for the result. estimate() waits
+// for it.
+class MonteCarloEstimator
+{
+public:
+    MonteCarloEstimator(
+        const int32 thread_count = 0);
+    ~MonteCarloEstimator();
+
+    MonteCarloEstimator(const MonteCarloEstimator&) = delete;
+    MonteCarloEstimator& operator= (const MonteCarloEstimator&) = delete;
+
+    MonteCarloResult estimate(
+        const HazardProblem& problem,
+        const MonteCarloSettings& settings);
+
+    // Cancels the estimate still running, if any. With a single thread
+    // the estimate is done before it returns.
+    void start(
+        const HazardProblem& problem,
+        const MonteCarloSettings& settings);
+
+    // True once, when the estimate last started is done.
+    bool poll(
+        MonteCarloResult& result);
+
+    // Stops the estimate running, its result is never given.
+    void cancel();
+
+    int32 get_thread_count() const { return std::max(1, (int32)m_threads.size()); }
+
+private:
+    struct Totals
+    {
+        double m_weight = 0.0;
+        double m_weight_squared = 0.0;
+        double m_hits[bitboard_capacity]{};
+        double m_hits_squared[bitboard_capacity]{};
+        int64 m_samples = 0;
+        int64 m_attempts = 0;
+
+        void add(
+            const Totals& other);
+    };
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready;
+    std::condition_variable m_work_done;
+    uint64 m_generation = 0;
+    int32 m_busy_threads = 0;
+    bool m_shutdown = false;
+
+    // The job currently being sampled, kept until its result is taken.
+    HazardProblem m_problem;
+    MonteCarloSettings m_settings;
+    std::chrono::steady_clock::time_point m_deadline;
+    std::atomic<bool> m_stop{ false };
+    Totals m_totals;
+    bool m_pending = false;
+
+    void worker(
+        const int32 thread_index);
+
+    MonteCarloResult make_result() const;
+
+    void sample_job(
+        const int32 thread_index,
+        const uint64 generation);
+
+    bool has_converged(
+        const Totals& totals,
+        const MonteCarloSettings& settings) const;
+};
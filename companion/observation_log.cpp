@@ -0,0 +1,216 @@
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include "observation_log.h"
+
+//////////////////////////////
+// ObservationLog
+//////////////////////////////
+
+void ObservationLog::begin(
+    const uint8 topology,
+    const int32 width,
+    const int32 height)
+{
+    uint8 header[log_header_size];
+    std::memcpy(header, &log_magic, 4);
+    std::memcpy(header + 4, &log_version, 2);
+    header[6] = topology;
+    header[7] = (uint8)width;
+    header[8] = (uint8)height;
+    m_pending.insert(m_pending.end(), header, header + log_header_size);
+}
+
+void ObservationLog::add(
+    const LogEvent& event)
+{
+    m_pending.push_back((uint8)(event.m_type | event.m_warnings << 3));
+    if (event.m_type == le_Select || event.m_type == le_Edit)
+    {
+        m_pending.push_back(event.m_room);
+    }
+
+    if (event.m_type == le_Edit)
+    {
+        m_pending.push_back((uint8)event.m_observation);
+        m_pending.push_back((uint8)(event.m_observation >> 8));
+    }
+
+    if (event.m_type == le_Settings)
+    {
+        uint8 error_rate[4];
+        std::memcpy(error_rate, &event.m_error_rate, 4);
+        m_pending.push_back(event.m_settings);
+        m_pending.insert(m_pending.end(), std::begin(event.m_hazard_counts), std::end(event.m_hazard_counts));
+        m_pending.insert(m_pending.end(), error_rate, error_rate + 4);
+    }
+}
+
+std::vector<uint8> ObservationLog::take_pending()
+{
+    return std::exchange(m_pending, {});
+}
+
+//////////////////////////////
+// LogAppender
+//////////////////////////////
+
+LogAppender::LogAppender(
+    const std::string& path,
+    const bool append) :
+    m_path(path),
+    m_truncate(!append)
+{
+    m_thread = std::thread(&LogAppender::worker, this);
+}
+
+LogAppender::~LogAppender()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_work_ready.notify_one();
+    m_thread.join();
+}
+
+void LogAppender::append(
+    const std::vector<uint8>& bytes)
+{
+    if (bytes.empty())
+        return;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_pending.insert(m_pending.end(), bytes.begin(), bytes.end());
+    }
+    m_work_ready.notify_one();
+}
+
+void LogAppender::worker()
+{
+    std::ofstream file(m_path, std::ios::binary | (m_truncate ? std::ios::trunc : std::ios::app));
+    m_failed = !file;
+
+    std::vector<uint8> bytes;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_work_ready.wait(lock, [this] { return !m_pending.empty() || m_shutdown; });
+
+            if (m_pending.empty())
+                return;
+
+            std::swap(bytes, m_pending);
+        }
+
+        // Flushed after every batch, a crash loses at most the one being
+        // written.
+        file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+        m_failed = !file.flush();
+        bytes.clear();
+    }
+}
+
+//////////////////////////////
+// ObservationLogReader
+//////////////////////////////
+
+ObservationLogReader::ObservationLogReader(
+    const std::string& path) :
+    m_file(path, std::ios::binary),
+    m_buffer(buffer_size)
+{
+    fill(log_header_size);
+    if (m_end - m_begin < log_header_size)
+        return;
+
+    uint32 magic;
+    uint16 version;
+    std::memcpy(&magic, m_buffer.data(), 4);
+    std::memcpy(&version, m_buffer.data() + 4, 2);
+    m_topology = m_buffer[6];
+    m_width = m_buffer[7];
+    m_height = m_buffer[8];
+    m_begin = log_header_size;
+
+    m_valid = magic == log_magic && version == log_version;
+}
+
+void ObservationLogReader::fill(
+    const size_t count)
+{
+    if (m_end - m_begin >= count)
+        return;
+
+    std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+    m_end -= m_begin;
+    m_begin = 0;
+
+    m_file.read((char*)m_buffer.data() + m_end, (std::streamsize)(buffer_size - m_end));
+    m_end += (size_t)m_file.gcount();
+}
+
+bool ObservationLogReader::next(
+    LogEvent& event)
+{
+    if (!m_valid)
+        return false;
+
+    fill(max_log_event_size);
+    if (m_begin == m_end)
+        return false;
+
+    const uint8* bytes = m_buffer.data() + m_begin;
+    size_t available = m_end - m_begin;
+
+    event = {};
+    event.m_type = (LogEventType)(bytes[0] & 7);
+    event.m_warnings = bytes[0] >> 3;
+
+    size_t size =
+        event.m_type == le_Select ? 2 :
+        event.m_type == le_Edit ? 4 :
+        event.m_type == le_Settings ? 9 :
+        1;
+
+    bool valid =
+        event.m_type < le__Count &&
+        (event.m_type == le_Explore || event.m_warnings == 0) &&
+        event.m_warnings < (1 << a__Count) &&
+        size <= available;
+
+    if (valid && event.m_type == le_Settings)
+    {
+        event.m_settings = bytes[1];
+        std::memcpy(event.m_hazard_counts, bytes + 2, a__Count);
+        std::memcpy(&event.m_error_rate, bytes + 5, 4);
+        valid =
+            event.m_settings < (1 << 6) &&
+            event.m_error_rate >= 0.01f && event.m_error_rate <= 0.3f;
+
+        for (uint8 count : event.m_hazard_counts)
+        {
+            valid &= count <= m_width * m_height;
+        }
+    }
+    else if (valid && size > 1)
+    {
+        event.m_room = bytes[1];
+        valid = event.m_room < m_width * m_height;
+    }
+
+    if (valid && event.m_type == le_Edit)
+    {
+        event.m_observation = (PackedRoom)(bytes[2] | bytes[3] << 8);
+        valid = ::is_valid(event.m_observation);
+    }
+
+    m_valid = valid;
+    if (!valid)
+        return false;
+
+    m_begin += size;
+    return true;
+}
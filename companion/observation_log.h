@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "packed_rooms.h"
+
+// Games are logged as what the player did, in an append-only file:
+//
+//   uint32 magic, uint16 version, uint8 topology, uint8 width,
+//   uint8 height, then the events
+//
+// Each event is a byte with the LogEventType in bits 0-2 and, for
+// le_Explore, the warnings of each attribute in bits 3-5. le_Select adds
+// a byte with the selected room's index, le_Edit that byte and the
+// observation as a little-endian PackedRoom. le_Settings adds the
+// board's settings bits, a byte per hazard count and the error rate as a
+// little-endian float; one starts every log and follows every change, so
+// a log replays the same whatever the replaying board was set to.
+//
+// The encoding only ever grows: new event types get new numbers and the
+// version goes up when an existing event changes.
+constexpr uint32 log_magic = 0x4C444E44;    // "DNDL"
+constexpr uint16 log_version = 1;
+constexpr size_t log_header_size = 4 + 2 + 1 + 1 + 1;
+
+// Longest event, in bytes.
+constexpr size_t max_log_event_size = 9;
+
+//////////////////////////////
+// LogEventType
+//////////////////////////////
+
+enum LogEventType
+{
+    le_Select,
+    le_Explore,
+    le_FoundAPit,
+    le_Reset,
+    le_Undo,
+    le_Redo,
+    le_Edit,
+    le_Settings,
+    le__Count,
+};
+
+static_assert(le__Count <= 8);
+
+//////////////////////////////
+// LogEvent
+//////////////////////////////
+
+struct LogEvent
+{
+    LogEventType m_type = le_Select;
+    uint8 m_room = 0;               // room index, le_Select and le_Edit
+    uint8 m_warnings = 0;           // a bit per attribute, le_Explore
+    PackedRoom m_observation = 0;   // le_Edit
+    uint8 m_settings = 0;           // Dungeon settings bits, le_Settings
+    uint8 m_hazard_counts[a__Count]{};      // le_Settings
+    float m_error_rate = 0.f;       // le_Settings
+
+    bool operator== (const LogEvent&) const = default;
+};
+
+//////////////////////////////
+// ObservationLog class
+//////////////////////////////
+
+// Encodes events into memory as they happen, for a LogAppender to take
+// to the file.
+class ObservationLog
+{
+public:
+    // The header of a new log, when starting one.
+    void begin(
+        const uint8 topology,
+        const int32 width,
+        const int32 height);
+
+    void add(
+        const LogEvent& event);
+
+    // What was added since the last call.
+    std::vector<uint8> take_pending();
+
+private:
+    std::vector<uint8> m_pending;
+};
+
+//////////////////////////////
+// LogAppender class
+//////////////////////////////
+
+// Appends to a log on a thread of its own, the same way an Autosaver
+// writes sessions: handing bytes over never waits on the disk.
+class LogAppender
+{
+public:
+    // Starts the file over unless appending.
+    LogAppender(
+        const std::string& path,
+        const bool append);
+
+    // Writes what is still pending before returning.
+    ~LogAppender();
+
+    LogAppender(const LogAppender&) = delete;
+    LogAppender& operator= (const LogAppender&) = delete;
+
+    void append(
+        const std::vector<uint8>& bytes);
+
+    bool has_failed() const { return m_failed; }
+
+private:
+    std::string m_path;
+    bool m_truncate;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready;
+    std::vector<uint8> m_pending;
+    bool m_shutdown = false;
+    std::atomic<bool> m_failed{ false };
+
+    void worker();
+};
+
+//////////////////////////////
+// ObservationLogReader class
+//////////////////////////////
+
+// Reads a log event by event through a fixed buffer, however long the
+// file is.
+class ObservationLogReader
+{
+public:
+    // Invalid when the file is missing or its header does not match.
+    ObservationLogReader(
+        const std::string& path);
+
+    bool is_valid() const { return m_valid; }
+    uint8 get_topology() const { return m_topology; }
+    int32 get_width() const { return m_width; }
+    int32 get_height() const { return m_height; }
+
+    // False at the end of the log. A damaged event also makes the reader
+    // invalid.
+    bool next(
+        LogEvent& event);
+
+private:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+    std::ifstream m_file;
+    std::vector<uint8> m_buffer;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    bool m_valid = false;
+    uint8 m_topology = 0;
+    int32 m_width = 0;
+    int32 m_height = 0;
+
+    // Tops the buffer up so that at least count bytes are in it, unless
+    // the file ends first.
+    void fill(
+        const size_t count);
+};
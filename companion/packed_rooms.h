@@ -0,0 +1,228 @@
+#pragma once
+
+#include "bitboard_engine.h"
+
+//////////////////////////////
+// PackedRooms
+//////////////////////////////
+
+// What is known about every room of a board in 2-bit fields, stored as
+// bit planes: plane 0 holds the low bit of each room's state, plane 1
+// the high bit. With the visited bit that is 13 bits per room, all of
+// it in 13 Bitboards whatever the board size, and it converts to and
+// from BoardMasks with a few word operations per state.
+//
+// That is 208 bytes. Planes cut to the room count would only get a 10x10
+// board down to 163, as 13 bits per room is the floor, and every
+// conversion would pay shifts across word boundaries for it.
+//
+// Trivially copyable, so a snapshot is a plain copy on the stack.
+struct PackedRooms
+{
+    Bitboard m_visited;
+    Bitboard m_neighbor_state[a__Count][2];     // NeighborState bit planes
+    Bitboard m_room_state[a__Count][2];         // RoomState bit planes
+
+    bool operator== (
+        const PackedRooms& other) const = default;
+};
+
+static_assert(ns__Count <= 4 && rs__Count <= 4);
+
+// One room of PackedRooms in 13 bits: the visited bit, then the warning
+// and the room state of each attribute.
+using PackedRoom = uint16;
+
+constexpr int32 packed_room_bits = 1 + 4 * a__Count;
+
+constexpr int32 get_neighbor_state_shift(
+    const Attribute attrib)
+{
+    return 1 + 4 * attrib;
+}
+
+constexpr int32 get_room_state_shift(
+    const Attribute attrib)
+{
+    return 3 + 4 * attrib;
+}
+
+// One-hot state masks to the two planes of their state values.
+constexpr void pack_states(
+    const Bitboard* masks,
+    const int32 state_count,
+    Bitboard* planes)
+{
+    planes[0] = {};
+    planes[1] = {};
+    for (int32 state = 1; state < state_count; state++)
+    {
+        if (state & 1)
+            planes[0] |= masks[state];
+        if (state & 2)
+            planes[1] |= masks[state];
+    }
+}
+
+// The other way around, rooms outside all get no state.
+constexpr void unpack_states(
+    const Bitboard* planes,
+    const int32 state_count,
+    const Bitboard& all,
+    Bitboard* masks)
+{
+    for (int32 state = 0; state < state_count; state++)
+    {
+        masks[state] =
+            all &
+            (state & 1 ? planes[0] : ~planes[0]) &
+            (state & 2 ? planes[1] : ~planes[1]);
+    }
+}
+
+// One room's state in a pair of planes.
+constexpr int32 get_packed_state(
+    const Bitboard* planes,
+    const int32 index)
+{
+    return (int32)planes[0].test(index) | ((int32)planes[1].test(index) << 1);
+}
+
+constexpr void set_packed_state(
+    Bitboard* planes,
+    const int32 index,
+    const int32 state)
+{
+    for (int32 bit = 0; bit < 2; bit++)
+    {
+        if ((state >> bit) & 1)
+            planes[bit].set(index);
+        else
+            planes[bit].reset(index);
+    }
+}
+
+constexpr PackedRooms pack_rooms(
+    const BoardMasks& masks)
+{
+    PackedRooms rooms;
+    rooms.m_visited = masks.m_visited;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        pack_states(masks.m_neighbor_state[a], ns__Count, rooms.m_neighbor_state[a]);
+        pack_states(masks.m_room_state[a], rs__Count, rooms.m_room_state[a]);
+    }
+    return rooms;
+}
+
+// Hazard counts are not part of the rooms and are left alone.
+constexpr void unpack_rooms(
+    const PackedRooms& rooms,
+    const Bitboard& all,
+    BoardMasks& masks)
+{
+    masks.m_visited = rooms.m_visited;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        unpack_states(rooms.m_neighbor_state[a], ns__Count, all, masks.m_neighbor_state[a]);
+        unpack_states(rooms.m_room_state[a], rs__Count, all, masks.m_room_state[a]);
+    }
+}
+
+constexpr PackedRoom get_packed_room(
+    const PackedRooms& rooms,
+    const int32 index)
+{
+    PackedRoom room = (PackedRoom)rooms.m_visited.test(index);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        room |= (PackedRoom)(get_packed_state(rooms.m_neighbor_state[a], index) << get_neighbor_state_shift((Attribute)a));
+        room |= (PackedRoom)(get_packed_state(rooms.m_room_state[a], index) << get_room_state_shift((Attribute)a));
+    }
+    return room;
+}
+
+constexpr void set_packed_room(
+    PackedRooms& rooms,
+    const int32 index,
+    const PackedRoom room)
+{
+    if (room & 1)
+        rooms.m_visited.set(index);
+    else
+        rooms.m_visited.reset(index);
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        set_packed_state(rooms.m_neighbor_state[a], index, (room >> get_neighbor_state_shift((Attribute)a)) & 3);
+        set_packed_state(rooms.m_room_state[a], index, (room >> get_room_state_shift((Attribute)a)) & 3);
+    }
+}
+
+// Rooms with any field that differs.
+constexpr Bitboard get_changed_rooms(
+    const PackedRooms& before,
+    const PackedRooms& after)
+{
+    Bitboard changed = before.m_visited ^ after.m_visited;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            changed |= before.m_neighbor_state[a][bit] ^ after.m_neighbor_state[a][bit];
+            changed |= before.m_room_state[a][bit] ^ after.m_room_state[a][bit];
+        }
+    }
+    return changed;
+}
+
+// Every state in range and no room outside all, for rooms read back
+// from a file.
+constexpr bool is_valid(
+    const PackedRooms& rooms,
+    const Bitboard& all)
+{
+    Bitboard outside = rooms.m_visited & ~all;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        for (int32 bit = 0; bit < 2; bit++)
+        {
+            outside |= (rooms.m_neighbor_state[a][bit] | rooms.m_room_state[a][bit]) & ~all;
+        }
+
+        if ((rooms.m_neighbor_state[a][0] & rooms.m_neighbor_state[a][1]).any())
+            return false;
+    }
+    return !outside.any();
+}
+
+constexpr bool is_valid(
+    const PackedRoom room)
+{
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        if (((room >> get_neighbor_state_shift((Attribute)a)) & 3) >= ns__Count)
+            return false;
+    }
+    return room < (1 << packed_room_bits);
+}
+
+//////////////////////////////
+// DungeonSnapshot
+//////////////////////////////
+
+// Everything a Dungeon knows about its rooms, for the history and
+// what-if analysis: the room states as derived, and the observations
+// they were derived from. An observation's room state is rs_Yes or
+// rs_No when set by hand, rs_Unknown otherwise.
+//
+// Two PackedRooms and the solver's verdict, 424 bytes with padding.
+struct DungeonSnapshot
+{
+    PackedRooms m_rooms;
+    PackedRooms m_observations;
+    uint8 m_inconsistent = 0;   // a bit per attribute the complete solver found no placement for
+
+    bool operator== (
+        const DungeonSnapshot& other) const = default;
+};
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include "probability_engine.h"
+
+// Cached components are dropped all at once when the cache grows past this.
+constexpr size_t max_cached_components = 4096;
+
+//////////////////////////////
+// CountPoly helpers
+//////////////////////////////
+
+CountPoly multiply(
+    const CountPoly& a,
+    const CountPoly& b)
+{
+    if (a.empty() || b.empty())
+        return {};
+
+    CountPoly result(a.size() + b.size() - 1, 0.0);
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        for (size_t j = 0; j < b.size(); j++)
+        {
+            result[i + j] += a[i] * b[j];
+        }
+    }
+    return result;
+}
+
+void add_shifted(
+    CountPoly& target,
+    const CountPoly& source,
+    const size_t shift)
+{
+    if (target.size() < source.size() + shift)
+    {
+        target.resize(source.size() + shift, 0.0);
+    }
+
+    for (size_t i = 0; i < source.size(); i++)
+    {
+        target[i + shift] += source[i];
+    }
+}
+
+// Ways to place k hazards in n rooms without constraints.
+CountPoly binomials(
+    const int32 n)
+{
+    CountPoly result(n + 1, 1.0);
+    for (int32 k = 1; k < n; k++)
+    {
+        result[k] = result[k - 1] * (n - k + 1) / k;
+    }
+    return result;
+}
+
+ComponentCount count_free(
+    const Bitboard& rooms)
+{
+    int32 n = rooms.count();
+    ComponentCount result{ rooms, binomials(n), {} };
+
+    CountPoly hits;
+    if (n > 0)
+    {
+        add_shifted(hits, binomials(n - 1), 1);
+    }
+    result.m_room_hits.assign(n, hits);
+    return result;
+}
+
+// Placements of two components with disjoint rooms.
+ComponentCount combine(
+    const ComponentCount& a,
+    const ComponentCount& b)
+{
+    ComponentCount result{ a.m_rooms | b.m_rooms, multiply(a.m_total, b.m_total), {} };
+
+    Bitboard rooms = result.m_rooms;
+    size_t a_index = 0;
+    size_t b_index = 0;
+    while (rooms.any())
+    {
+        int32 index = rooms.first();
+        rooms.reset(index);
+
+        if (a.m_rooms.test(index))
+        {
+            result.m_room_hits.push_back(multiply(a.m_room_hits[a_index++], b.m_total));
+        }
+        else
+        {
+            result.m_room_hits.push_back(multiply(b.m_room_hits[b_index++], a.m_total));
+        }
+    }
+
+    return result;
+}
+
+bool is_clause_less(
+    const Bitboard& a,
+    const Bitboard& b)
+{
+    return a.m_words[1] != b.m_words[1] ?
+        a.m_words[1] < b.m_words[1] :
+        a.m_words[0] < b.m_words[0];
+}
+
+// Sorted, without duplicates and without clauses implied by smaller ones,
+// so equal components get equal keys.
+void normalize_clauses(
+    std::vector<Bitboard>& clauses)
+{
+    std::sort(clauses.begin(), clauses.end(), is_clause_less);
+    clauses.erase(std::unique(clauses.begin(), clauses.end()), clauses.end());
+
+    auto is_implied = [&clauses](const Bitboard& clause)
+    {
+        for (const Bitboard& other : clauses)
+        {
+            if (!(other == clause) && !(other & ~clause).any())
+                return true;
+        }
+        return false;
+    };
+
+    std::vector<Bitboard> kept;
+    for (const Bitboard& clause : clauses)
+    {
+        if (!is_implied(clause))
+        {
+            kept.push_back(clause);
+        }
+    }
+    clauses = std::move(kept);
+}
+
+//////////////////////////////
+// ProbabilityEngine
+//////////////////////////////
+
+size_t ProbabilityEngine::ComponentKeyHash::operator() (
+    const ComponentKey& key) const
+{
+    uint64 hash = key.m_rooms.m_words[0] * 0x9E3779B97F4A7C15ull ^ key.m_rooms.m_words[1];
+    for (const Bitboard& clause : key.m_clauses)
+    {
+        hash = (hash ^ clause.m_words[0]) * 0x100000001B3ull;
+        hash = (hash ^ clause.m_words[1]) * 0x100000001B3ull;
+    }
+    return (size_t)hash;
+}
+
+bool ProbabilityEngine::compute(
+    const HazardProblem& problem,
+    float* probabilities,
+    ProbabilityStats& stats)
+{
+    if (m_cache.size() > max_cached_components)
+    {
+        m_cache.clear();
+    }
+
+    for (const Bitboard& clause : problem.m_clauses)
+    {
+        if (!clause.any())
+            return false;
+    }
+
+    ClauseComponents components;
+    Bitboard free;
+    split_components(problem.m_open, problem.m_clauses, components, free);
+
+    std::vector<const ComponentCount*> parts;
+    for (auto& [rooms, clauses] : components)
+    {
+        stats.m_components++;
+        stats.m_largest_component = std::max(stats.m_largest_component, rooms.count());
+        parts.push_back(&count_component(rooms, std::move(clauses), stats));
+    }
+
+    ComponentCount free_count = count_free(free);
+    parts.push_back(&free_count);
+
+    // Placements of every other part, for each part.
+    std::vector<CountPoly> prefix(parts.size() + 1, CountPoly{ 1.0 });
+    std::vector<CountPoly> suffix(parts.size() + 1, CountPoly{ 1.0 });
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        prefix[i + 1] = multiply(prefix[i], parts[i]->m_total);
+        suffix[parts.size() - 1 - i] = multiply(suffix[parts.size() - i], parts[parts.size() - 1 - i]->m_total);
+    }
+
+    int32 known = problem.m_yes.count();
+    auto is_valid = [&problem, known](const size_t k)
+    {
+        return (int32)k + known >= problem.m_min_count && (int32)k + known <= problem.m_max_count;
+    };
+
+    double total = 0.0;
+    for (size_t k = 0; k < prefix.back().size(); k++)
+    {
+        if (is_valid(k))
+            total += prefix.back()[k];
+    }
+
+    if (total <= 0.0)
+        return false;
+
+    for (int32 i = 0; i < bitboard_capacity; i++)
+    {
+        probabilities[i] = problem.m_yes.test(i) ? 1.f : 0.f;
+    }
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        const ComponentCount& part = *parts[i];
+        CountPoly others = multiply(prefix[i], suffix[i + 1]);
+
+        // weight[j]: placements of the other parts that make a valid total
+        // together with j hazards in this part.
+        CountPoly weight(part.m_total.size(), 0.0);
+        for (size_t j = 0; j < weight.size(); j++)
+        {
+            for (size_t k = 0; k < others.size(); k++)
+            {
+                if (is_valid(j + k))
+                    weight[j] += others[k];
+            }
+        }
+
+        Bitboard rooms = part.m_rooms;
+        for (const CountPoly& hits : part.m_room_hits)
+        {
+            int32 index = rooms.first();
+            rooms.reset(index);
+
+            double count = 0.0;
+            for (size_t j = 0; j < hits.size() && j < weight.size(); j++)
+            {
+                count += hits[j] * weight[j];
+            }
+            probabilities[index] = (float)(count / total);
+        }
+    }
+
+    return true;
+}
+
+const ComponentCount& ProbabilityEngine::count_component(
+    const Bitboard& rooms,
+    std::vector<Bitboard> clauses,
+    ProbabilityStats& stats)
+{
+    normalize_clauses(clauses);
+    ComponentKey key{ rooms, std::move(clauses) };
+
+    auto found = m_cache.find(key);
+    if (found != m_cache.end())
+    {
+        stats.m_cache_hits++;
+        return found->second;
+    }
+
+    ComponentCount count = count_uncached(key.m_rooms, key.m_clauses, stats);
+    return m_cache.emplace(std::move(key), std::move(count)).first->second;
+}
+
+ComponentCount ProbabilityEngine::count_uncached(
+    const Bitboard& rooms,
+    const std::vector<Bitboard>& clauses,
+    ProbabilityStats& stats)
+{
+    stats.m_nodes++;
+
+    if (clauses.empty())
+        return count_free(rooms);
+
+    ClauseComponents components;
+    Bitboard free;
+    split_components(rooms, clauses, components, free);
+
+    if (free.any() || components.size() > 1)
+    {
+        ComponentCount result = count_free(free);
+        for (auto& [component_rooms, component_clauses] : components)
+        {
+            result = combine(result, count_component(component_rooms, std::move(component_clauses), stats));
+        }
+        return result;
+    }
+
+    // A single connected component, branch on its busiest room.
+    int32 branch_room = rooms.first();
+    int32 branch_uses = 0;
+    Bitboard candidates = rooms;
+    while (candidates.any())
+    {
+        int32 index = candidates.first();
+        candidates.reset(index);
+
+        int32 uses = 0;
+        for (const Bitboard& clause : clauses)
+        {
+            uses += clause.test(index);
+        }
+
+        if (uses > branch_uses)
+        {
+            branch_room = index;
+            branch_uses = uses;
+        }
+    }
+
+    Bitboard branch;
+    branch.set(branch_room);
+    Bitboard rest = rooms & ~branch;
+
+    std::vector<Bitboard> with_clauses;
+    std::vector<Bitboard> without_clauses;
+    bool without_possible = true;
+    for (const Bitboard& clause : clauses)
+    {
+        if (!clause.test(branch_room))
+        {
+            with_clauses.push_back(clause);
+            without_clauses.push_back(clause);
+            continue;
+        }
+
+        Bitboard reduced = clause & ~branch;
+        without_possible &= reduced.any();
+        without_clauses.push_back(reduced);
+    }
+
+    ComponentCount impossible{ rest, {}, {} };
+    impossible.m_room_hits.resize(rest.count());
+
+    const ComponentCount& with = count_component(rest, std::move(with_clauses), stats);
+    const ComponentCount& without = without_possible ?
+        count_component(rest, std::move(without_clauses), stats) :
+        impossible;
+
+    ComponentCount result{ rooms, {}, {} };
+    add_shifted(result.m_total, with.m_total, 1);
+    add_shifted(result.m_total, without.m_total, 0);
+
+    Bitboard remaining = rooms;
+    size_t rest_index = 0;
+    while (remaining.any())
+    {
+        int32 index = remaining.first();
+        remaining.reset(index);
+
+        CountPoly hits;
+        if (index == branch_room)
+        {
+            add_shifted(hits, with.m_total, 1);
+        }
+        else
+        {
+            add_shifted(hits, with.m_room_hits[rest_index], 1);
+            add_shifted(hits, without.m_room_hits[rest_index], 0);
+            rest_index++;
+        }
+        result.m_room_hits.push_back(std::move(hits));
+    }
+
+    return result;
+}
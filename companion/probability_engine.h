@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "entailment_solver.h"
+
+//////////////////////////////
+// CountPoly
+//////////////////////////////
+
+// Number of placements indexed by how many hazards they use. Counts grow
+// like 2^rooms, so they are kept as doubles.
+using CountPoly = std::vector<double>;
+
+//////////////////////////////
+// ComponentCount
+//////////////////////////////
+
+struct ComponentCount
+{
+    Bitboard m_rooms;
+    CountPoly m_total;
+    std::vector<CountPoly> m_room_hits;     // per room of m_rooms in index order
+};
+
+//////////////////////////////
+// ProbabilityStats
+//////////////////////////////
+
+struct ProbabilityStats
+{
+    int32 m_components = 0;
+    int32 m_largest_component = 0;
+    int32 m_nodes = 0;
+    int32 m_cache_hits = 0;
+};
+
+//////////////////////////////
+// ProbabilityEngine class
+//////////////////////////////
+
+// Exact hazard probability per room, uniform over all placements that
+// agree with a HazardProblem. Warnings only tie together the rooms they
+// share, so undecided rooms split into independent components which are
+// counted separately (splitting again as rooms get decided) and combined
+// through their hazard-count polynomials. Component counts are cached by
+// content, so after an observation only the components it touched are
+// counted again.
+class ProbabilityEngine
+{
+public:
+    // False if no placement fits. Otherwise fills one probability per
+    // room, 1 for known hazards and 0 for known empty rooms.
+    bool compute(
+        const HazardProblem& problem,
+        float* probabilities,
+        ProbabilityStats& stats);
+
+private:
+    struct ComponentKey
+    {
+        Bitboard m_rooms;
+        std::vector<Bitboard> m_clauses;
+
+        bool operator== (
+            const ComponentKey& other) const = default;
+    };
+
+    struct ComponentKeyHash
+    {
+        size_t operator() (
+            const ComponentKey& key) const;
+    };
+
+    std::unordered_map<ComponentKey, ComponentCount, ComponentKeyHash> m_cache;
+
+    const ComponentCount& count_component(
+        const Bitboard& rooms,
+        std::vector<Bitboard> clauses,
+        ProbabilityStats& stats);
+
+    ComponentCount count_uncached(
+        const Bitboard& rooms,
+        const std::vector<Bitboard>& clauses,
+        ProbabilityStats& stats);
+};
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <iterator>
+#include "provenance.h"
+
+ProvenanceTracker::ProvenanceTracker(
+    const BoardGeometry& geometry) :
+    m_geometry(geometry)
+{
+    for (int32 i = 0; i < m_geometry.room_count(); i++)
+    {
+        Bitboard room;
+        room.set(i);
+        m_room_neighbors[i] = m_geometry.neighbors_of(room);
+    }
+}
+
+void ProvenanceTracker::reset()
+{
+    for (auto& provenance : m_provenance)
+    {
+        std::fill(std::begin(provenance), std::end(provenance), Provenance{});
+    }
+
+    for (auto& dependents : m_dependents)
+    {
+        std::fill(std::begin(dependents), std::end(dependents), Bitboard{});
+    }
+}
+
+void ProvenanceTracker::explain(
+    const BoardMasks& masks,
+    const Bitboard& rooms,
+    const Bitboard* assumed)
+{
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        Attribute attrib = (Attribute)a;
+        const Bitboard* room_state = masks.m_room_state[a];
+
+        Bitboard undecided = rooms & ~room_state[rs_No] & ~room_state[rs_Yes];
+        while (undecided.any())
+        {
+            int32 index = undecided.first();
+            undecided.reset(index);
+            set_provenance(attrib, index, {});
+        }
+
+        Bitboard by_hand = rooms & assumed[a] & (room_state[rs_No] | room_state[rs_Yes]);
+        while (by_hand.any())
+        {
+            int32 index = by_hand.first();
+            by_hand.reset(index);
+
+            Bitboard room;
+            room.set(index);
+            set_provenance(attrib, index, { dr_None, room });
+        }
+
+        // Empty rooms first, the rules for hazards build on them. Only the
+        // count rule for empty rooms builds on hazards, it goes last.
+        Bitboard no = rooms & room_state[rs_No] & ~assumed[a];
+        Bitboard counted;
+        while (no.any())
+        {
+            int32 index = no.first();
+            no.reset(index);
+
+            Provenance provenance = explain_no(masks, assumed[a], attrib, index);
+            if (provenance.m_rule == dr_Count)
+                counted.set(index);
+            set_provenance(attrib, index, provenance);
+        }
+
+        Bitboard yes = rooms & room_state[rs_Yes] & ~assumed[a];
+        while (yes.any())
+        {
+            int32 index = yes.first();
+            yes.reset(index);
+            set_provenance(attrib, index, explain_yes(masks, assumed[a], attrib, index));
+        }
+
+        // Empty by count, resting on the hazards and on what they rest on.
+        Bitboard hazards = room_state[rs_Yes] | get_sources(attrib, room_state[rs_Yes]);
+        while (counted.any())
+        {
+            int32 index = counted.first();
+            counted.reset(index);
+            set_provenance(attrib, index, { dr_Count, hazards });
+        }
+    }
+}
+
+void ProvenanceTracker::set_provenance(
+    const Attribute attrib,
+    const int32 index,
+    const Provenance& provenance)
+{
+    Bitboard* dependents = m_dependents[attrib];
+
+    Bitboard sources = m_provenance[attrib][index].m_sources;
+    while (sources.any())
+    {
+        int32 source = sources.first();
+        sources.reset(source);
+        dependents[source].reset(index);
+    }
+
+    sources = provenance.m_sources;
+    while (sources.any())
+    {
+        int32 source = sources.first();
+        sources.reset(source);
+        dependents[source].set(index);
+    }
+
+    m_provenance[attrib][index] = provenance;
+}
+
+Bitboard ProvenanceTracker::get_sources(
+    const Attribute attrib,
+    Bitboard rooms) const
+{
+    Bitboard sources;
+    while (rooms.any())
+    {
+        int32 index = rooms.first();
+        rooms.reset(index);
+        sources |= m_provenance[attrib][index].m_sources;
+    }
+    return sources;
+}
+
+Provenance ProvenanceTracker::explain_no(
+    const BoardMasks& masks,
+    const Bitboard& assumed,
+    const Attribute attrib,
+    const int32 index) const
+{
+    Bitboard room;
+    room.set(index);
+
+    if ((masks.m_visited & room).any())
+        return { dr_Visited, room };
+
+    const Bitboard* neighbor_state = masks.m_neighbor_state[attrib];
+    Bitboard quiet = m_room_neighbors[index] & neighbor_state[ns_No];
+    if (quiet.any())
+        return { dr_NoWarning, quiet };
+
+    if (is_hazard_unique(attrib))
+    {
+        Bitboard far = neighbor_state[ns_Yes] & ~m_room_neighbors[index];
+        if (far.any())
+        {
+            Bitboard source;
+            source.set(far.first());
+            return { dr_Dragon, source };
+        }
+    }
+
+    // The hazards themselves for now, explain() adds what they rest on
+    // once they are explained.
+    const Bitboard& yes = masks.m_room_state[attrib][rs_Yes];
+    int32 count = get_hazard_count(masks, attrib);
+    if (count >= 0 && yes.count() >= count)
+        return { dr_Count, yes };
+
+    return { dr_Global, masks.m_visited | assumed };
+}
+
+Provenance ProvenanceTracker::explain_yes(
+    const BoardMasks& masks,
+    const Bitboard& assumed,
+    const Attribute attrib,
+    const int32 index) const
+{
+    Bitboard room;
+    room.set(index);
+
+    if ((masks.m_visited & room).any())
+        return { dr_Visited, room };
+
+    const Bitboard* room_state = masks.m_room_state[attrib];
+    Bitboard warnings = m_room_neighbors[index] & masks.m_neighbor_state[attrib][ns_Yes];
+    while (warnings.any())
+    {
+        int32 warning = warnings.first();
+        warnings.reset(warning);
+
+        Bitboard others = m_room_neighbors[warning] & ~room;
+        if (!(others & ~room_state[rs_No]).any())
+        {
+            Bitboard sources = get_sources(attrib, others);
+            sources.set(warning);
+            return { dr_Unit, sources };
+        }
+    }
+
+    int32 count = get_hazard_count(masks, attrib);
+    Bitboard undecided = m_geometry.all() & ~room_state[rs_No] & ~room_state[rs_Yes];
+    if (count >= 0 && room_state[rs_Yes].count() + undecided.count() <= count)
+        return { dr_Count, get_sources(attrib, room_state[rs_No]) };
+
+    return { dr_Global, masks.m_visited | assumed };
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "bitboard_engine.h"
+
+//////////////////////////////
+// DeductionRule
+//////////////////////////////
+
+enum DeductionRule
+{
+    dr_None,        // undecided, or decided by hand
+    dr_Visited,     // the room itself was visited
+    dr_NoWarning,   // next to a room without a warning
+    dr_Unit,        // the last candidate of a warning
+    dr_Dragon,      // not next to a dragon warning, there is only one dragon
+    dr_Count,       // the hazard total is used up, or just reached
+    dr_Global,      // the complete solver, from all observations together
+    dr__Count,
+};
+
+//////////////////////////////
+// Provenance
+//////////////////////////////
+
+// Why a room is rs_Yes or rs_No: the rule and the visited or hand-set
+// rooms whose observations it rests on, including those behind the
+// rooms it used. A room empty by count also rests on the hazards.
+struct Provenance
+{
+    DeductionRule m_rule = dr_None;
+    Bitboard m_sources;
+};
+
+//////////////////////////////
+// ProvenanceTracker class
+//////////////////////////////
+
+// Explains decided room states after the engines have run, from the
+// board alone, so the engines themselves need no bookkeeping. Only rooms
+// whose state changed need explaining, and explanations of earlier rooms
+// are reused for the later ones that depend on them. The sources are also
+// indexed the other way around, so the states resting on an observation
+// are found without a scan.
+class ProvenanceTracker
+{
+public:
+    ProvenanceTracker(
+        const BoardGeometry& geometry);
+
+    void reset();
+
+    // Explains the given rooms of every attribute as they are in masks.
+    // Rooms in assumed (one mask per attribute) were decided by hand and
+    // rest on themselves.
+    void explain(
+        const BoardMasks& masks,
+        const Bitboard& rooms,
+        const Bitboard* assumed);
+
+    const Provenance& get_provenance(
+        const int32 index,
+        const Attribute attrib) const
+    {
+        return m_provenance[attrib][index];
+    }
+
+    // Rooms whose state of the attribute rests on what was observed in
+    // the source room.
+    const Bitboard& get_dependents(
+        const int32 source,
+        const Attribute attrib) const
+    {
+        return m_dependents[attrib][source];
+    }
+
+private:
+    BoardGeometry m_geometry;
+    Bitboard m_room_neighbors[bitboard_capacity];
+    Provenance m_provenance[a__Count][bitboard_capacity];
+    Bitboard m_dependents[a__Count][bitboard_capacity];
+
+    void set_provenance(
+        const Attribute attrib,
+        const int32 index,
+        const Provenance& provenance);
+
+    Bitboard get_sources(
+        const Attribute attrib,
+        Bitboard rooms) const;
+
+    Provenance explain_no(
+        const BoardMasks& masks,
+        const Bitboard& assumed,
+        const Attribute attrib,
+        const int32 index) const;
+
+    Provenance explain_yes(
+        const BoardMasks& masks,
+        const Bitboard& assumed,
+        const Attribute attrib,
+        const int32 index) const;
+};
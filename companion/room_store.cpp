@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cassert>
+#include "room_store.h"
+
+template <int32 Width, int32 Height, typename Topology>
+RoomStore<Width, Height, Topology>::RoomStore(
+    const int32 width,
+    const int32 height) :
+    m_width(width),
+    m_height(height)
+{
+    assert(is_dynamic || (width == Width && height == Height));
+
+    if constexpr (is_dynamic)
+    {
+        int32 slot_count = get_room_count() + (Topology::has_walls ? 1 : 0);
+        m_visited.resize((width * height + 63) / 64);
+        for (int32 i = 0; i < a__Count; i++)
+        {
+            m_neighbor_state[i].resize(slot_count);
+            m_room_state[i].resize(slot_count);
+            m_estimates[i].resize(get_room_count());
+        }
+
+        m_neighbors.resize(get_room_count());
+        for (int32 index = 0; index < get_room_count(); index++)
+        {
+            ivec2 pos = get_pos(index);
+            m_neighbors[index] = Topology::get_neighbors(pos.x, pos.y, width, height);
+        }
+    }
+
+    reset();
+}
+
+template <int32 Width, int32 Height, typename Topology>
+void RoomStore<Width, Height, Topology>::reset()
+{
+    std::fill(m_visited.begin(), m_visited.end(), 0);
+    for (int32 i = 0; i < a__Count; i++)
+    {
+        std::fill(m_neighbor_state[i].begin(), m_neighbor_state[i].end(), (uint8)ns_Unknown);
+        std::fill(m_room_state[i].begin(), m_room_state[i].end(), (uint8)rs_Unknown);
+        std::fill(m_estimates[i].begin(), m_estimates[i].end(), HazardEstimate{});
+
+        if constexpr (Topology::has_walls)
+        {
+            m_room_state[i][get_room_count()] = (uint8)rs_No;
+        }
+    }
+}
+
+template <int32 Width, int32 Height, typename Topology>
+int32 RoomStore<Width, Height, Topology>::get_index(
+    const ivec2& pos) const
+{
+    int32 x = pos.x;
+
+    while (x < 0)
+        x += get_width();
+
+    while (x >= get_width())
+        x -= get_width();
+
+    int32 y = pos.y;
+
+    while (y < 0)
+        y += get_height();
+
+    while (y >= get_height())
+        y -= get_height();
+
+    return y * get_width() + x;
+}
+
+template class RoomStore<dungeon_size, dungeon_size, Torus>;
+template class RoomStore<dynamic_size, dynamic_size, Torus>;
+template class RoomStore<dungeon_size, dungeon_size, WalledGrid>;
+template class RoomStore<dynamic_size, dynamic_size, WalledGrid>;
+template class RoomStore<dungeon_size, dungeon_size, HexGrid>;
+template class RoomStore<dynamic_size, dynamic_size, HexGrid>;
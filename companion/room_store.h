@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+#include <vector>
+#include "dungeon_types.h"
+#include "topology.h"
+
+// Neighbors of a room in the topology's direction order.
+template <typename Topology>
+using NeighborArray = std::array<int32, Topology::direction_count>;
+
+// Board dimensions given at run time instead of compile time.
+constexpr int32 dynamic_size = 0;
+
+//////////////////////////////
+// HazardEstimate
+//////////////////////////////
+
+// Display values computed from the room states, not part of them.
+struct HazardEstimate
+{
+    float m_probability = -1.f;     // negative when not computed
+    float m_half_width = 0.f;       // confidence half-width when sampled
+    float m_belief = -1.f;          // noisy observations mode, negative when off
+};
+
+//////////////////////////////
+// RoomStore class
+//////////////////////////////
+
+// What is known about every room of a board, one array per field indexed
+// by y * width + x: a byte per room for each attribute's room state and
+// warning, and a bit per room for visits. Whole-board sweeps read
+// contiguous memory and copying a board is a handful of flat copies.
+//
+// With fixed dimensions the arrays are std::arrays and neighbors are
+// computed from constants. With dynamic_size dimensions come from the
+// constructor, the arrays are vectors and neighbors come from a table
+// built once, so the rules never wrap coordinates either way.
+//
+// With walls the state arrays have one more slot, the wall every edge
+// room has as neighbor: rs_No and ns_Unknown for all attributes, so the
+// rules read it like an empty room without a known warning.
+template <int32 Width, int32 Height, typename Topology>
+class RoomStore
+{
+public:
+    static constexpr bool is_dynamic = Width == dynamic_size || Height == dynamic_size;
+
+    RoomStore(
+        const int32 width,
+        const int32 height);
+
+    void reset();
+
+    int32 get_width() const { return is_dynamic ? m_width : Width; }
+    int32 get_height() const { return is_dynamic ? m_height : Height; }
+    int32 get_room_count() const { return get_width() * get_height(); }
+    bool is_wall(
+        const int32 index) const { return Topology::has_walls && index == get_room_count(); }
+
+    // Positions wrap around the edges, like the handheld board.
+    int32 get_index(
+        const ivec2& pos) const;
+    ivec2 get_pos(
+        const int32 index) const { return { index % get_width(), index / get_width() }; }
+    // Only for rooms of the board, not the wall.
+    NeighborArray<Topology> get_neighbors(
+        const int32 index) const;
+
+    bool is_visited(
+        const int32 index) const { return (m_visited[index / 64] >> (index % 64)) & 1; }
+    void set_visited(
+        const int32 index,
+        const bool visited)
+    {
+        uint64 bit = 1ull << (index % 64);
+        m_visited[index / 64] = visited ? m_visited[index / 64] | bit : m_visited[index / 64] & ~bit;
+    }
+
+    NeighborState get_neighbor_state(
+        const int32 index,
+        const Attribute attrib) const { return (NeighborState)m_neighbor_state[attrib][index]; }
+    void set_neighbor_state(
+        const int32 index,
+        const Attribute attrib,
+        const NeighborState state) { m_neighbor_state[attrib][index] = (uint8)state; }
+
+    RoomState get_room_state(
+        const int32 index,
+        const Attribute attrib) const { return (RoomState)m_room_state[attrib][index]; }
+    void set_room_state(
+        const int32 index,
+        const Attribute attrib,
+        const RoomState state) { m_room_state[attrib][index] = (uint8)state; }
+
+    // Whole arrays, for sweeps over the board.
+    const uint64* get_visited_words() const { return m_visited.data(); }
+    uint64* get_visited_words() { return m_visited.data(); }
+    const uint8* get_neighbor_states(
+        const Attribute attrib) const { return m_neighbor_state[attrib].data(); }
+    uint8* get_neighbor_states(
+        const Attribute attrib) { return m_neighbor_state[attrib].data(); }
+    const uint8* get_room_states(
+        const Attribute attrib) const { return m_room_state[attrib].data(); }
+    uint8* get_room_states(
+        const Attribute attrib) { return m_room_state[attrib].data(); }
+
+    const HazardEstimate& get_estimate(
+        const int32 index,
+        const Attribute attrib) const { return m_estimates[attrib][index]; }
+    HazardEstimate& get_estimate(
+        const int32 index,
+        const Attribute attrib) { return m_estimates[attrib][index]; }
+
+private:
+    template <typename T, int32 Count>
+    using Array = std::conditional_t<is_dynamic, std::vector<T>, std::array<T, Count>>;
+
+    static constexpr int32 room_count = Width * Height;
+    static constexpr int32 slot_count = room_count + (Topology::has_walls ? 1 : 0);
+
+    int32 m_width;
+    int32 m_height;
+    std::vector<NeighborArray<Topology>> m_neighbors;  // dynamic_size only
+    Array<uint64, (room_count + 63) / 64> m_visited;
+    Array<uint8, slot_count> m_neighbor_state[a__Count];
+    Array<uint8, slot_count> m_room_state[a__Count];
+    Array<HazardEstimate, room_count> m_estimates[a__Count];
+};
+
+template <int32 Width, int32 Height, typename Topology>
+NeighborArray<Topology> RoomStore<Width, Height, Topology>::get_neighbors(
+    const int32 index) const
+{
+    if constexpr (is_dynamic)
+    {
+        return m_neighbors[index];
+    }
+    else
+    {
+        return Topology::get_neighbors(index % Width, index / Width, Width, Height);
+    }
+}
@@ -0,0 +1,297 @@
+#include <filesystem>
+#include "session.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a over 8-byte words, enough to tell a damaged file from a good
+// one. Each word goes through an invertible step, so a single damaged
+// word always shows.
+uint64 get_checksum(
+    const uint8* data,
+    const size_t size)
+{
+    constexpr uint64 prime = 0x100000001B3ull;
+    uint64 hash = 0xCBF29CE484222325ull;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64 word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+
+    for (; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+//////////////////////////////
+// SessionWriter
+//////////////////////////////
+
+SessionWriter::SessionWriter(
+    const uint8 topology,
+    const int32 width,
+    const int32 height)
+{
+    m_bytes.resize(4096);          // a long game before growing
+    write(session_magic);
+    write(session_version);
+    write(topology);
+    write((uint8)width);
+    write((uint8)height);
+    write(uint32(0));
+    write(uint64(0));
+}
+
+std::vector<uint8> SessionWriter::finish()
+{
+    m_bytes.resize(m_size);
+    uint32 payload_size = (uint32)(m_size - session_header_size);
+    uint64 checksum = get_checksum(m_bytes.data() + session_header_size, payload_size);
+    std::memcpy(m_bytes.data() + session_header_size - 12, &payload_size, sizeof(payload_size));
+    std::memcpy(m_bytes.data() + session_header_size - 8, &checksum, sizeof(checksum));
+    return std::move(m_bytes);
+}
+
+//////////////////////////////
+// SessionReader
+//////////////////////////////
+
+SessionReader::SessionReader(
+    const uint8* data,
+    const size_t size,
+    const uint8 topology,
+    const int32 width,
+    const int32 height) :
+    m_data(data),
+    m_size(size)
+{
+    if (size < session_header_size)
+        return;
+
+    uint32 magic;
+    uint16 version;
+    uint8 header_topology;
+    uint8 header_width;
+    uint8 header_height;
+    uint32 payload_size;
+    uint64 checksum;
+
+    size_t offset = 0;
+    auto read_header = [&](auto& value)
+    {
+        std::memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+    };
+    read_header(magic);
+    read_header(version);
+    read_header(header_topology);
+    read_header(header_width);
+    read_header(header_height);
+    read_header(payload_size);
+    read_header(checksum);
+
+    m_valid =
+        magic == session_magic &&
+        version == session_version &&
+        header_topology == topology &&
+        header_width == width &&
+        header_height == height &&
+        payload_size == size - session_header_size &&
+        checksum == get_checksum(data + session_header_size, payload_size);
+}
+
+//////////////////////////////
+// MappedFile
+//////////////////////////////
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(
+    const std::string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return;
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return;
+
+    m_data = (const uint8*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data)
+    {
+        m_size = (size_t)size.QuadPart;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+}
+
+// On the disk, not only in the system's cache, when it returns true.
+static bool write_through(
+    const std::string& path,
+    const std::vector<uint8>& bytes)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD written = 0;
+    bool written_through =
+        WriteFile(file, bytes.data(), (DWORD)bytes.size(), &written, nullptr) &&
+        written == bytes.size() &&
+        FlushFileBuffers(file);
+
+    return CloseHandle(file) && written_through;
+}
+
+#else
+
+MappedFile::MappedFile(
+    const std::string& path)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return;
+
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED)
+        {
+            m_data = (const uint8*)data;
+            m_size = (size_t)status.st_size;
+        }
+    }
+
+    // The mapping stays valid without the descriptor.
+    close(file);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        munmap((void*)m_data, m_size);
+}
+
+// On the disk, not only in the system's cache, when it returns true.
+static bool write_through(
+    const std::string& path,
+    const std::vector<uint8>& bytes)
+{
+    int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+        return false;
+
+    size_t offset = 0;
+    while (offset < bytes.size())
+    {
+        ssize_t written = write(file, bytes.data() + offset, bytes.size() - offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+
+        offset += (size_t)written;
+    }
+
+    bool written_through = offset == bytes.size() && fsync(file) == 0;
+    return close(file) == 0 && written_through;
+}
+
+#endif
+
+bool write_file(
+    const std::string& path,
+    const std::vector<uint8>& bytes)
+{
+    // The rename must not reach the disk before the bytes do.
+    std::string temporary_path = path + ".tmp";
+    if (!write_through(temporary_path, bytes))
+        return false;
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    return !error;
+}
+
+//////////////////////////////
+// Autosaver
+//////////////////////////////
+
+Autosaver::Autosaver(
+    const std::string& path) :
+    m_path(path)
+{
+    m_thread = std::thread(&Autosaver::worker, this);
+}
+
+Autosaver::~Autosaver()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_work_ready.notify_one();
+    m_thread.join();
+}
+
+void Autosaver::save(
+    std::vector<uint8>&& bytes)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_pending = std::move(bytes);
+        m_has_pending = true;
+    }
+    m_work_ready.notify_one();
+}
+
+void Autosaver::worker()
+{
+    std::vector<uint8> bytes;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_work_ready.wait(lock, [this] { return m_has_pending || m_shutdown; });
+
+            if (!m_has_pending)
+                return;
+
+            std::swap(bytes, m_pending);
+            m_has_pending = false;
+        }
+
+        m_failed = !write_file(m_path, bytes);
+    }
+}
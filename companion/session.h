@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "dungeon_types.h"
+
+// Saved sessions are a header and a payload of fields written one after
+// the other in the machine's byte order, with no padding:
+//
+//   uint32 magic, uint16 version, uint8 topology, uint8 width,
+//   uint8 height, uint32 payload size, uint64 payload checksum
+//
+// A file that was cut short or has a different layout fails the checks
+// and is ignored. The version goes up whenever the payload changes.
+static_assert(std::endian::native == std::endian::little);
+
+constexpr uint32 session_magic = 0x53444E44;    // "DNDS"
+constexpr uint16 session_version = 2;
+constexpr size_t session_header_size = 4 + 2 + 1 + 1 + 1 + 4 + 8;
+
+//////////////////////////////
+// SessionWriter class
+//////////////////////////////
+
+class SessionWriter
+{
+public:
+    SessionWriter(
+        const uint8 topology,
+        const int32 width,
+        const int32 height);
+
+    template <typename T>
+    void write(
+        const T& value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        if (m_size + sizeof(T) > m_bytes.size())
+        {
+            m_bytes.resize(std::max(m_bytes.size() * 2, m_size + sizeof(T)));
+        }
+
+        std::memcpy(m_bytes.data() + m_size, &value, sizeof(T));
+        m_size += sizeof(T);
+    }
+
+    // Fills in the payload size and checksum, the writer is spent after.
+    std::vector<uint8> finish();
+
+private:
+    std::vector<uint8> m_bytes;     // grown ahead of the writes
+    size_t m_size = 0;
+};
+
+//////////////////////////////
+// SessionReader class
+//////////////////////////////
+
+// Reads in place from memory that outlives the reader, a mapped file
+// typically. Reads past the end fail and leave the value alone.
+class SessionReader
+{
+public:
+    // Invalid unless the header matches and the checksum agrees.
+    SessionReader(
+        const uint8* data,
+        const size_t size,
+        const uint8 topology,
+        const int32 width,
+        const int32 height);
+
+    template <typename T>
+    bool read(
+        T& value)
+    {
+        static_assert(std::is_arithmetic_v<T>);
+        if (!m_valid || m_size - m_offset < sizeof(T))
+        {
+            m_valid = false;
+            return false;
+        }
+
+        std::memcpy(&value, m_data + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    bool is_valid() const { return m_valid; }
+
+    bool has_bytes(
+        const size_t count) const { return m_valid && m_size - m_offset >= count; }
+
+    // Valid, and every byte of the payload read.
+    bool is_complete() const { return m_valid && m_offset == m_size; }
+
+private:
+    const uint8* m_data;
+    size_t m_size;
+    size_t m_offset = session_header_size;
+    bool m_valid = false;
+};
+
+//////////////////////////////
+// MappedFile class
+//////////////////////////////
+
+// A whole file mapped read-only, empty when it could not be opened.
+class MappedFile
+{
+public:
+    MappedFile(
+        const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator= (const MappedFile&) = delete;
+
+    const uint8* get_data() const { return m_data; }
+    size_t get_size() const { return m_size; }
+
+private:
+    const uint8* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+// Replaces the file as a whole: the bytes go to a temporary file first,
+// flushed to the disk, which is then renamed over it, so a crash never
+// leaves half a file.
+bool write_file(
+    const std::string& path,
+    const std::vector<uint8>& bytes);
+
+//////////////////////////////
+// Autosaver class
+//////////////////////////////
+
+// Writes sessions on a thread of its own. Handing one over only swaps a
+// buffer under a lock the writer never holds while writing, so the
+// caller never waits on the disk. When sessions come faster than they
+// are written, only the latest one is.
+class Autosaver
+{
+public:
+    Autosaver(
+        const std::string& path);
+
+    // Writes what is still pending before returning.
+    ~Autosaver();
+
+    Autosaver(const Autosaver&) = delete;
+    Autosaver& operator= (const Autosaver&) = delete;
+
+    void save(
+        std::vector<uint8>&& bytes);
+
+    // The last write did not make it to the disk.
+    bool has_failed() const { return m_failed; }
+
+private:
+    std::string m_path;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready;
+    std::vector<uint8> m_pending;
+    bool m_has_pending = false;
+    bool m_shutdown = false;
+    std::atomic<bool> m_failed{ false };
+
+    void worker();
+};
@@ -0,0 +1,575 @@
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "simulator.h"
+
+HiddenDungeon generate_dungeon(
+    const BoardGeometry& geometry,
+    const int32* hazard_counts,
+    SimulatorRng& rng)
+{
+    HiddenDungeon dungeon;
+    dungeon.m_start = pick_room(geometry.all(), rng);
+
+    Bitboard rooms = geometry.all();
+    rooms.reset(dungeon.m_start);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        Bitboard free = rooms;
+        int32 count = std::min(hazard_counts[a], free.count());
+        for (int32 i = 0; i < count; i++)
+        {
+            int32 index = pick_room(free, rng);
+            free.reset(index);
+            dungeon.m_hazards[a].set(index);
+        }
+    }
+    return dungeon;
+}
+
+uint8 get_warnings(
+    const HiddenDungeon& dungeon,
+    const BoardGeometry& geometry,
+    const int32 index)
+{
+    Bitboard room;
+    room.set(index);
+    Bitboard neighbors = geometry.neighbors_of(room);
+
+    uint8 warnings = 0;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        warnings |= (uint8)((dungeon.m_hazards[a] & neighbors).any() << a);
+    }
+    return warnings;
+}
+
+Attribute get_hazard(
+    const HiddenDungeon& dungeon,
+    const int32 index)
+{
+    for (int32 a = a__Count - 1; a >= 0; a--)
+    {
+        if (dungeon.m_hazards[a].test(index))
+            return (Attribute)a;
+    }
+    return a__Count;
+}
+
+int32 pick_room(
+    const Bitboard& rooms,
+    SimulatorRng& rng)
+{
+    assert(rooms.any());
+    std::uniform_int_distribution<int32> dist(0, rooms.count() - 1);
+    int32 skip = dist(rng);
+
+    // Finds the word and then the byte holding the picked room, and
+    // drops the rooms before it in that byte.
+    int32 low_count = std::popcount(rooms.m_words[0]);
+    uint64 word = skip < low_count ? rooms.m_words[0] : rooms.m_words[1];
+    int32 index = skip < low_count ? 0 : 64;
+    skip -= skip < low_count ? 0 : low_count;
+
+    for (int32 count = std::popcount(word & 0xFF); skip >= count; count = std::popcount(word & 0xFF))
+    {
+        skip -= count;
+        word >>= 8;
+        index += 8;
+    }
+
+    for (; skip > 0; skip--)
+    {
+        word &= word - 1;
+    }
+    return index + std::countr_zero(word);
+}
+
+SimulatorRng make_game_rng(
+    const uint64 seed,
+    const int64 game_index)
+{
+    // A single word seeds the generator in a fraction of what a seed_seq
+    // takes, which shows at a game every few microseconds. SplitMix64
+    // spreads neighboring games to unrelated seeds.
+    uint64 mixed = seed + (uint64)game_index * 0x9E3779B97F4A7C15ull;
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+    return SimulatorRng(mixed ^ (mixed >> 31));
+}
+
+// Spreads a run's games over the threads, worker(next_game, stats) plays
+// them on each, and adds up what they played.
+template <typename Worker>
+SimulationStats run_on_threads(
+    const int32 threads,
+    Worker&& worker)
+{
+    int32 thread_count = threads > 0 ?
+        threads :
+        std::max(1, (int32)std::thread::hardware_concurrency());
+
+    std::atomic<int64> next_game{ 0 };
+    std::vector<SimulationStats> thread_stats(thread_count);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> thread_pool;
+    for (int32 i = 1; i < thread_count; i++)
+    {
+        thread_pool.emplace_back([&, i] { worker(next_game, thread_stats[i]); });
+    }
+    worker(next_game, thread_stats[0]);
+    for (std::thread& thread : thread_pool)
+    {
+        thread.join();
+    }
+
+    SimulationStats stats;
+    for (const SimulationStats& partial : thread_stats)
+    {
+        stats.add(partial);
+    }
+    stats.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+//////////////////////////////
+// MovePolicy
+//////////////////////////////
+
+PolicyView make_policy_view(
+    const BoardGeometry& geometry,
+    const BoardMasks& masks,
+    const int32 position)
+{
+    Bitboard hazards;
+    Bitboard safe = geometry.all();
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        hazards |= masks.m_room_state[a][rs_Yes];
+        safe &= masks.m_room_state[a][rs_No];
+    }
+
+    Bitboard frontier = geometry.neighbors_of(masks.m_visited) & ~masks.m_visited & ~hazards;
+    return { geometry, masks, frontier, frontier & safe, position };
+}
+
+int32 RandomSafePolicy::choose_room(
+    const PolicyView& view,
+    SimulatorRng& rng) const
+{
+    return pick_room(view.m_safe.any() ? view.m_safe : view.m_frontier, rng);
+}
+
+int32 NearestSafePolicy::choose_room(
+    const PolicyView& view,
+    SimulatorRng& rng) const
+{
+    const Bitboard& targets = view.m_safe.any() ? view.m_safe : view.m_frontier;
+
+    // Rings of rooms one step further each time, only visited rooms lead
+    // on. Every frontier room is next to one, so a ring finds the target.
+    Bitboard ring;
+    ring.set(view.m_position);
+    Bitboard reached = ring;
+    while (ring.any())
+    {
+        Bitboard next = view.m_geometry.neighbors_of(ring) & ~reached;
+        if ((next & targets).any())
+            return pick_room(next & targets, rng);
+
+        reached |= next;
+        ring = next & view.m_masks.m_visited;
+    }
+    return pick_room(targets, rng);
+}
+
+int32 InformationGainPolicy::choose_room(
+    const PolicyView& view,
+    SimulatorRng& rng) const
+{
+    const BoardMasks& masks = view.m_masks;
+
+    Bitboard decided = view.m_geometry.all();
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        decided &= masks.m_room_state[a][rs_No] | masks.m_room_state[a][rs_Yes];
+    }
+    Bitboard undecided = view.m_geometry.all() & ~decided;
+
+    // Higher scores are better, the best rooms are picked among evenly.
+    Bitboard best;
+    int32 best_score = std::numeric_limits<int32>::min();
+    Bitboard rooms = view.m_safe.any() ? view.m_safe : view.m_frontier;
+    while (rooms.any())
+    {
+        int32 index = rooms.first();
+        rooms.reset(index);
+
+        Bitboard room;
+        room.set(index);
+
+        int32 score = 0;
+        if (view.m_safe.any())
+        {
+            score = (view.m_geometry.neighbors_of(room) & undecided).count();
+        }
+        else
+        {
+            for (int32 a = 0; a < a__Count; a++)
+            {
+                score -= masks.m_room_state[a][rs_Maybe].test(index);
+            }
+        }
+
+        if (score > best_score)
+        {
+            best = {};
+            best_score = score;
+        }
+        if (score == best_score)
+        {
+            best.set(index);
+        }
+    }
+    return pick_room(best, rng);
+}
+
+//////////////////////////////
+// SimulationStats
+//////////////////////////////
+
+void SimulationStats::add(
+    const GameResult& result)
+{
+    m_games++;
+    m_wins += result.m_won;
+    m_stuck += !result.m_won && result.m_death == a__Count;
+    if (result.m_death != a__Count)
+    {
+        m_deaths[result.m_death]++;
+    }
+
+    m_moves += result.m_moves;
+    m_won_moves += result.m_won ? result.m_moves : 0;
+    m_guesses += result.m_guesses;
+    m_guessed_games += result.m_guesses > 0;
+}
+
+void SimulationStats::add(
+    const SimulationStats& stats)
+{
+    m_games += stats.m_games;
+    m_wins += stats.m_wins;
+    m_stuck += stats.m_stuck;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        m_deaths[a] += stats.m_deaths[a];
+    }
+
+    m_moves += stats.m_moves;
+    m_won_moves += stats.m_won_moves;
+    m_guesses += stats.m_guesses;
+    m_guessed_games += stats.m_guessed_games;
+}
+
+//////////////////////////////
+// Simulator
+//////////////////////////////
+
+template <int32 Width, int32 Height, typename Topology>
+Simulator<Width, Height, Topology>::Simulator(
+    const SimulatorSettings& settings) :
+    m_settings(settings),
+    m_geometry(make_fitting_geometry(
+        Topology{},
+        RoomStore<Width, Height, Topology>::is_dynamic ? settings.m_width : Width,
+        RoomStore<Width, Height, Topology>::is_dynamic ? settings.m_height : Height))
+{
+}
+
+template <int32 Width, int32 Height, typename Topology>
+std::unique_ptr<Dungeon<Width, Height, Topology>> Simulator<Width, Height, Topology>::make_dungeon() const
+{
+    // Games already run one per thread, sampling stays on the caller's.
+    std::unique_ptr<SimDungeon> dungeon;
+    if constexpr (RoomStore<Width, Height, Topology>::is_dynamic)
+    {
+        dungeon = std::make_unique<SimDungeon>(m_geometry.width(), m_geometry.height(), 1);
+    }
+    else
+    {
+        dungeon = std::make_unique<SimDungeon>(1);
+    }
+
+    dungeon->set_headless(true);
+    return dungeon;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+SimulationStats Simulator<Width, Height, Topology>::run(
+    const MovePolicy& policy) const
+{
+    if (!is_valid())
+        return {};
+
+    return run_on_threads(m_settings.m_threads, [&](std::atomic<int64>& next_game, SimulationStats& stats)
+    {
+        std::unique_ptr<SimDungeon> dungeon = make_dungeon();
+        for (;;)
+        {
+            int64 first = next_game.fetch_add(batch_size);
+            if (first >= m_settings.m_games)
+                break;
+
+            int64 last = std::min(first + batch_size, m_settings.m_games);
+            for (int64 game_index = first; game_index < last; game_index++)
+            {
+                stats.add(play_game(*dungeon, game_index, policy));
+            }
+        }
+    });
+}
+
+template <int32 Width, int32 Height, typename Topology>
+GameResult Simulator<Width, Height, Topology>::play_game(
+    SimDungeon& dungeon,
+    const int64 game_index,
+    const MovePolicy& policy) const
+{
+    assert(is_valid());
+
+    SimulatorRng rng = make_game_rng(m_settings.m_seed, game_index);
+    HiddenDungeon hidden = generate_dungeon(m_geometry, m_settings.m_hazard_counts, rng);
+
+    dungeon.reset();
+    dungeon.clear_history();
+
+    GameResult result;
+    int32 position = hidden.m_start;
+    for (;;)
+    {
+        dungeon.select_room({ position % m_geometry.width(), position / m_geometry.width() });
+
+        Attribute hazard = get_hazard(hidden, position);
+        if (hazard == a_Pit && !m_settings.m_fatal_pits)
+        {
+            dungeon.found_a_pit();
+        }
+        else if (hazard != a__Count)
+        {
+            result.m_death = hazard;
+            return result;
+        }
+        else
+        {
+            uint8 warnings = get_warnings(hidden, m_geometry, position);
+            dungeon.explore(warnings & 1, (warnings >> 1) & 1, (warnings >> 2) & 1);
+        }
+
+        BoardMasks masks = dungeon.get_board_masks();
+        if (masks.m_room_state[a_Dragon][rs_Yes].any())
+        {
+            result.m_won = true;
+            return result;
+        }
+
+        PolicyView view = make_policy_view(m_geometry, masks, position);
+        if (!view.m_frontier.any())
+            return result;
+
+        result.m_guesses += !view.m_safe.any();
+        result.m_moves++;
+
+        position = policy.choose_room(view, rng);
+        assert(view.m_frontier.test(position));
+    }
+}
+
+template class Simulator<dungeon_size, dungeon_size, Torus>;
+template class Simulator<dynamic_size, dynamic_size, Torus>;
+template class Simulator<dungeon_size, dungeon_size, WalledGrid>;
+template class Simulator<dynamic_size, dynamic_size, WalledGrid>;
+template class Simulator<dungeon_size, dungeon_size, HexGrid>;
+template class Simulator<dynamic_size, dynamic_size, HexGrid>;
+
+//////////////////////////////
+// LaneSimulator
+//////////////////////////////
+
+LaneSimulator::LaneSimulator(
+    const BoardGeometry& geometry,
+    const SimulatorSettings& settings) :
+    m_settings(settings),
+    m_engine(geometry)
+{
+}
+
+SimulationStats LaneSimulator::run(
+    const MovePolicy& policy) const
+{
+    return run_on_threads(m_settings.m_threads, [&](std::atomic<int64>& next_game, SimulationStats& stats)
+    {
+        play_games(next_game, policy, stats);
+    });
+}
+
+void LaneSimulator::play_games(
+    std::atomic<int64>& next_game,
+    const MovePolicy& policy,
+    SimulationStats& stats) const
+{
+    // Large enough that they go on the heap.
+    auto masks = std::make_unique<LaneMasks>();
+    auto changed = std::make_unique<LaneBoard>();
+    auto games = std::make_unique<LaneGame[]>(lane_count);
+
+    int32 active = 0;
+    for (int32 lane = 0; lane < lane_count; lane++)
+    {
+        active += start_game(next_game, games[lane], games[lane].m_masks);
+        masks->set_lane(lane, games[lane].m_masks);
+    }
+
+    while (active > 0)
+    {
+        // Only the rooms the rules changed go back to the games, a few
+        // per step, instead of every lane's board.
+        m_engine.run_to_fixpoint(*masks, *changed);
+        for (int32 index = 0; index < m_engine.get_geometry().room_count(); index++)
+        {
+            for (int32 word = 0; word < register_words; word++)
+            {
+                uint64 lanes = changed->m_rooms[index].m_words[word];
+                while (lanes)
+                {
+                    int32 lane = word * 64 + std::countr_zero(lanes);
+                    lanes &= lanes - 1;
+                    masks->get_room_states(lane, index, games[lane].m_masks);
+                }
+            }
+        }
+
+        for (int32 lane = 0; lane < lane_count; lane++)
+        {
+            LaneGame& game = games[lane];
+            if (game.m_index < 0)
+                continue;
+
+            // A step changes the room entered, a new game every room.
+            if (step(game, game.m_masks, policy))
+            {
+                masks->set_room(lane, game.m_position, game.m_masks);
+                continue;
+            }
+
+            stats.add(game.m_result);
+            if (!start_game(next_game, game, game.m_masks))
+            {
+                active--;
+            }
+            masks->set_lane(lane, game.m_masks);
+        }
+    }
+}
+
+bool LaneSimulator::start_game(
+    std::atomic<int64>& next_game,
+    LaneGame& game,
+    BoardMasks& masks) const
+{
+    const BoardGeometry& geometry = m_engine.get_geometry();
+
+    // An idle lane holds an empty board, which the rules leave alone.
+    masks = {};
+    game.m_index = next_game.fetch_add(1);
+    if (game.m_index >= m_settings.m_games)
+    {
+        game.m_index = -1;
+        return false;
+    }
+
+    game.m_rng = make_game_rng(m_settings.m_seed, game.m_index);
+    game.m_hidden = generate_dungeon(geometry, m_settings.m_hazard_counts, game.m_rng);
+    game.m_result = {};
+
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        masks.m_neighbor_state[a][ns_Unknown] = geometry.all();
+        masks.m_room_state[a][rs_Unknown] = geometry.all();
+    }
+
+    // The start room is empty, the game goes on.
+    return enter_room(game, masks, game.m_hidden.m_start);
+}
+
+bool LaneSimulator::enter_room(
+    LaneGame& game,
+    BoardMasks& masks,
+    const int32 index) const
+{
+    game.m_position = index;
+
+    Attribute hazard = get_hazard(game.m_hidden, index);
+    if (hazard != a__Count && (hazard != a_Pit || m_settings.m_fatal_pits))
+    {
+        game.m_result.m_death = hazard;
+        return false;
+    }
+
+    // What Dungeon::explore() and Dungeon::found_a_pit() enter.
+    Bitboard room;
+    room.set(index);
+    masks.m_visited |= room;
+
+    if (hazard == a_Pit)
+    {
+        move_to_state(masks.m_room_state[a_Pit], room, rs_Yes);
+        return true;
+    }
+
+    uint8 warnings = get_warnings(game.m_hidden, m_engine.get_geometry(), index);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        if (!(masks.m_room_state[a][rs_Yes] & room).any())
+        {
+            move_to_state(masks.m_room_state[a], room, rs_No);
+        }
+
+        Bitboard* neighbor_state = masks.m_neighbor_state[a];
+        for (int32 state = 0; state < ns__Count; state++)
+        {
+            neighbor_state[state] &= ~room;
+        }
+        neighbor_state[(warnings >> a) & 1 ? ns_Yes : ns_No] |= room;
+    }
+    return true;
+}
+
+bool LaneSimulator::step(
+    LaneGame& game,
+    BoardMasks& masks,
+    const MovePolicy& policy) const
+{
+    if (masks.m_room_state[a_Dragon][rs_Yes].any())
+    {
+        game.m_result.m_won = true;
+        return false;
+    }
+
+    PolicyView view = make_policy_view(m_engine.get_geometry(), masks, game.m_position);
+    if (!view.m_frontier.any())
+        return false;
+
+    game.m_result.m_guesses += !view.m_safe.any();
+    game.m_result.m_moves++;
+
+    int32 position = policy.choose_room(view, game.m_rng);
+    assert(view.m_frontier.test(position));
+    return enter_room(game, masks, position);
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include "dungeon.h"
+#include "lane_engine.h"
+
+using SimulatorRng = std::mt19937_64;
+
+//////////////////////////////
+// HiddenDungeon
+//////////////////////////////
+
+// Where the hazards really are, which the player only learns by
+// exploring. Each attribute is placed on its own, so a pit and an arrow
+// may share a room. The room the player starts in is always empty.
+struct HiddenDungeon
+{
+    Bitboard m_hazards[a__Count];
+    int32 m_start = 0;
+};
+
+HiddenDungeon generate_dungeon(
+    const BoardGeometry& geometry,
+    const int32* hazard_counts,
+    SimulatorRng& rng);
+
+// The warnings explore() gets in the room, a bit per attribute as in
+// LogEvent::m_warnings.
+uint8 get_warnings(
+    const HiddenDungeon& dungeon,
+    const BoardGeometry& geometry,
+    const int32 index);
+
+// The worst hazard in the room, a__Count when it is empty.
+Attribute get_hazard(
+    const HiddenDungeon& dungeon,
+    const int32 index);
+
+// One of the rooms, picked uniformly. There must be at least one.
+int32 pick_room(
+    const Bitboard& rooms,
+    SimulatorRng& rng);
+
+// Game i of a run draws everything from this stream.
+SimulatorRng make_game_rng(
+    const uint64 seed,
+    const int64 game_index);
+
+//////////////////////////////
+// MovePolicy
+//////////////////////////////
+
+// What a policy gets to decide the next room from.
+struct PolicyView
+{
+    const BoardGeometry& m_geometry;
+    const BoardMasks& m_masks;
+    Bitboard m_frontier;        // unvisited rooms next to a visited one, not known hazards
+    Bitboard m_safe;            // the frontier rooms known to be empty
+    int32 m_position;           // room the player is in
+};
+
+// Nothing left to choose from when the frontier is empty.
+PolicyView make_policy_view(
+    const BoardGeometry& geometry,
+    const BoardMasks& masks,
+    const int32 position);
+
+// Decides where the player goes next. One policy plays every game of a
+// run on all threads at once, so choose_room() must not change it.
+class MovePolicy
+{
+public:
+    virtual ~MovePolicy() = default;
+
+    virtual const char* get_name() const = 0;
+
+    // One of the view's frontier rooms.
+    virtual int32 choose_room(
+        const PolicyView& view,
+        SimulatorRng& rng) const = 0;
+};
+
+// Enters a random room known to be empty, and guesses among the whole
+// frontier when there is none.
+class RandomSafePolicy : public MovePolicy
+{
+public:
+    const char* get_name() const override { return "random safe"; }
+
+    int32 choose_room(
+        const PolicyView& view,
+        SimulatorRng& rng) const override;
+};
+
+// Enters the known empty room closest to the player, walking through
+// visited rooms, and guesses the closest frontier room when there is
+// none.
+class NearestSafePolicy : public MovePolicy
+{
+public:
+    const char* get_name() const override { return "nearest safe"; }
+
+    int32 choose_room(
+        const PolicyView& view,
+        SimulatorRng& rng) const override;
+};
+
+// Enters the known empty room next to the most rooms not yet known
+// either way, which its warnings tell the most about. When it has to
+// guess, it picks a room warned about for the fewest attributes.
+class InformationGainPolicy : public MovePolicy
+{
+public:
+    const char* get_name() const override { return "information gain"; }
+
+    int32 choose_room(
+        const PolicyView& view,
+        SimulatorRng& rng) const override;
+};
+
+//////////////////////////////
+// SimulationStats
+//////////////////////////////
+
+struct GameResult
+{
+    bool m_won = false;             // the dragon's room was deduced
+    Attribute m_death = a__Count;   // what killed the player, a__Count if nothing did
+    int32 m_moves = 0;              // rooms entered after the start
+    int32 m_guesses = 0;            // moves made with no room known to be empty
+};
+
+struct SimulationStats
+{
+    int64 m_games = 0;
+    int64 m_wins = 0;
+    int64 m_deaths[a__Count]{};
+    int64 m_stuck = 0;              // neither won nor dead, the frontier ran out
+    int64 m_moves = 0;
+    int64 m_won_moves = 0;          // moves of the games won
+    int64 m_guesses = 0;
+    int64 m_guessed_games = 0;      // games with at least one guess
+    double m_seconds = 0.0;
+
+    void add(
+        const GameResult& result);
+    void add(
+        const SimulationStats& stats);
+};
+
+//////////////////////////////
+// SimulatorSettings
+//////////////////////////////
+
+struct SimulatorSettings
+{
+    int64 m_games = 100000;
+    int32 m_threads = 0;            // 0 for one per core
+    uint64 m_seed = 0x5EED;
+    int32 m_width = dungeon_size;   // dynamic boards only
+    int32 m_height = dungeon_size;
+    int32 m_hazard_counts[a__Count]{ 8, 4, 1 };
+    bool m_fatal_pits = false;      // the handheld lets the player climb out
+};
+
+//////////////////////////////
+// Simulator class
+//////////////////////////////
+
+// Plays whole games on headless Dungeons against hidden dungeons it
+// generates, the player entering whatever room the policy chooses. A game
+// is won once the dragon's room is deduced and lost when the player walks
+// into the dragon or an arrow, or into a pit if those are fatal.
+//
+// Games are spread over the threads in batches, each thread with a
+// Dungeon of its own. Game i is generated and played from a random stream
+// seeded with the seed and i alone, so a run gives the same results
+// whatever the thread count. Only the boards instantiated at the end of
+// simulator.cpp are available.
+//
+// Games are played on bitboards, so a board sized at run time that does
+// not fit in one is not played: the simulator is invalid and runs no
+// games.
+template <int32 Width = dungeon_size, int32 Height = Width, typename Topology = Torus>
+class Simulator
+{
+public:
+    using SimDungeon = Dungeon<Width, Height, Topology>;
+
+    Simulator(
+        const SimulatorSettings& settings);
+
+    bool is_valid() const { return m_geometry.room_count() > 0; }
+
+    SimulationStats run(
+        const MovePolicy& policy) const;
+
+    GameResult play_game(
+        SimDungeon& dungeon,
+        const int64 game_index,
+        const MovePolicy& policy) const;
+
+    std::unique_ptr<SimDungeon> make_dungeon() const;
+
+    const BoardGeometry& get_geometry() const { return m_geometry; }
+    const SimulatorSettings& get_settings() const { return m_settings; }
+
+private:
+    static constexpr int64 batch_size = 64;
+
+    SimulatorSettings m_settings;
+    BoardGeometry m_geometry;
+};
+
+//////////////////////////////
+// LaneSimulator class
+//////////////////////////////
+
+// Plays games lane_count at a time on a LaneEngine, for when throughput
+// matters more than deducing everything: the room rules alone leave the
+// player guessing where a Dungeon would not. The games, their seeding and
+// the policy are those of a Simulator, and a lane whose game ends takes
+// the run's next game right away so that every lane stays busy.
+class LaneSimulator
+{
+public:
+    LaneSimulator(
+        const BoardGeometry& geometry,
+        const SimulatorSettings& settings);
+
+    SimulationStats run(
+        const MovePolicy& policy) const;
+
+private:
+    struct LaneGame
+    {
+        int64 m_index = -1;         // -1 once the run has no game left for the lane
+        HiddenDungeon m_hidden;
+        int32 m_position = 0;
+        SimulatorRng m_rng;
+        GameResult m_result;
+        BoardMasks m_masks;         // the lane's board for the policy, copied back a changed room at a time
+    };
+
+    SimulatorSettings m_settings;
+    LaneEngine m_engine;
+
+    void play_games(
+        std::atomic<int64>& next_game,
+        const MovePolicy& policy,
+        SimulationStats& stats) const;
+
+    // Takes the run's next game and enters its first room.
+    bool start_game(
+        std::atomic<int64>& next_game,
+        LaneGame& game,
+        BoardMasks& masks) const;
+
+    // Enters a room, false once the game is over.
+    bool enter_room(
+        LaneGame& game,
+        BoardMasks& masks,
+        const int32 index) const;
+
+    // Moves on from what the rules deduced, false once the game is over.
+    bool step(
+        LaneGame& game,
+        BoardMasks& masks,
+        const MovePolicy& policy) const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include "dungeon_types.h"
+
+// Names a snapshot taken by a SnapshotArena, in the order they were taken.
+using SnapshotId = uint64;
+
+//////////////////////////////
+// SnapshotArena class
+//////////////////////////////
+
+// Keeps the last Capacity snapshots in place, overwriting the oldest one
+// first. Snapshots go in and come out by value and nothing is allocated
+// after construction, so taking one costs a copy of the snapshot. Ids
+// keep counting up, so a stale id is told apart from a live one.
+template <typename Snapshot, int32 Capacity>
+class SnapshotArena
+{
+public:
+    static_assert(Capacity > 0);
+
+    SnapshotId push(
+        const Snapshot& snapshot)
+    {
+        m_slots[m_next % Capacity] = snapshot;
+        return m_next++;
+    }
+
+    // False once the snapshot was overwritten or the arena cleared.
+    bool contains(
+        const SnapshotId id) const { return id < m_next && m_next - id <= (uint64)get_size(); }
+
+    Snapshot get(
+        const SnapshotId id) const
+    {
+        assert(contains(id));
+        return m_slots[id % Capacity];
+    }
+
+    // Id of the next snapshot, one past the latest.
+    SnapshotId get_next_id() const { return m_next; }
+    int32 get_size() const { return (int32)std::min<uint64>(m_next - m_first, Capacity); }
+
+    void clear() { m_first = m_next; }
+
+private:
+    std::array<Snapshot, Capacity> m_slots{};
+    SnapshotId m_next = 0;
+    SnapshotId m_first = 0;     // first id pushed since the last clear
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include "dungeon_types.h"
+
+// How the rooms of a board connect, as a policy the board and the rule
+// engines are templated on. A topology lists the neighbors of a room
+// given its position, with plain arithmetic and selects so the compiler
+// folds it into each caller. Directions come in opposite pairs, the
+// opposite of direction being direction ^ 1.
+//
+// A neighbor behind a wall is the room count: one slot past the board
+// that reads as a room known to be empty, so the rules treat an edge
+// room like any other instead of testing for edges.
+
+// Most directions of any topology below.
+constexpr int32 max_direction_count = 6;
+
+//////////////////////////////
+// Torus
+//////////////////////////////
+
+// The handheld's board, leaving it on one side enters it on the other.
+// Neighbors are west, east, north and south.
+struct Torus
+{
+    static constexpr int32 direction_count = 4;
+    static constexpr bool has_walls = false;
+    static constexpr float odd_row_offset = 0.f;    // in rooms, when drawn
+    static constexpr uint8 id = 0;                  // in saved sessions
+
+    static constexpr std::array<int32, direction_count> get_neighbors(
+        const int32 x,
+        const int32 y,
+        const int32 width,
+        const int32 height)
+    {
+        int32 index = y * width + x;
+        int32 room_count = width * height;
+        return {
+            x == 0 ? index + width - 1 : index - 1,
+            x == width - 1 ? index - width + 1 : index + 1,
+            y == 0 ? index + room_count - width : index - width,
+            y == height - 1 ? index - room_count + width : index + width,
+        };
+    }
+};
+
+//////////////////////////////
+// WalledGrid
+//////////////////////////////
+
+// A bounded board, the same four neighbors as the torus but none across
+// the edges.
+struct WalledGrid
+{
+    static constexpr int32 direction_count = 4;
+    static constexpr bool has_walls = true;
+    static constexpr float odd_row_offset = 0.f;
+    static constexpr uint8 id = 1;
+
+    static constexpr std::array<int32, direction_count> get_neighbors(
+        const int32 x,
+        const int32 y,
+        const int32 width,
+        const int32 height)
+    {
+        int32 index = y * width + x;
+        int32 wall = width * height;
+        return {
+            x == 0 ? wall : index - 1,
+            x == width - 1 ? wall : index + 1,
+            y == 0 ? wall : index - width,
+            y == height - 1 ? wall : index + width,
+        };
+    }
+};
+
+//////////////////////////////
+// HexGrid
+//////////////////////////////
+
+// A bounded board of hexagons in rows, odd rows half a room to the right
+// of even ones. Neighbors are west, east, north-west, south-east,
+// north-east and south-west.
+struct HexGrid
+{
+    static constexpr int32 direction_count = 6;
+    static constexpr bool has_walls = true;
+    static constexpr float odd_row_offset = 0.5f;
+    static constexpr uint8 id = 2;
+
+    static constexpr std::array<int32, direction_count> get_neighbors(
+        const int32 x,
+        const int32 y,
+        const int32 width,
+        const int32 height)
+    {
+        int32 index = y * width + x;
+        int32 wall = width * height;
+        int32 odd = y & 1;          // rows above and below lean right
+        bool left = x + odd > 0;    // the row above and below has a room on the left
+        bool right = x + odd < width;
+        return {
+            x == 0 ? wall : index - 1,
+            x == width - 1 ? wall : index + 1,
+            y == 0 || !left ? wall : index - width - 1 + odd,
+            y == height - 1 || !right ? wall : index + width + odd,
+            y == 0 || !right ? wall : index - width + odd,
+            y == height - 1 || !left ? wall : index + width - 1 + odd,
+        };
+    }
+};
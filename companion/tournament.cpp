@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "tournament.h"
+
+//////////////////////////////
+// Tournament
+//////////////////////////////
+
+template <int32 Width, int32 Height, typename Topology>
+Tournament<Width, Height, Topology>::Tournament(
+    const SimulatorSettings& settings,
+    const SprtSettings& sprt) :
+    m_simulator(settings),
+    m_sprt(sprt)
+{
+}
+
+template <int32 Width, int32 Height, typename Topology>
+MatchResult Tournament<Width, Height, Topology>::play_match(
+    const MovePolicy& first,
+    const MovePolicy& second) const
+{
+    const SimulatorSettings& settings = m_simulator.get_settings();
+
+    MatchResult match;
+    match.m_policies[0] = &first;
+    match.m_policies[1] = &second;
+    if (!m_simulator.is_valid())
+        return match;
+
+    // A pair the first policy won moves the ratio up by step, one the
+    // second won moves it down as far, as the two hypotheses mirror.
+    double step = std::log((0.5 + m_sprt.m_margin) / (0.5 - m_sprt.m_margin));
+    double upper = std::log((1.0 - m_sprt.m_beta) / m_sprt.m_alpha);
+    double lower = std::log(m_sprt.m_beta / (1.0 - m_sprt.m_alpha));
+
+    std::atomic<int64> next_game{ 0 };
+    std::atomic<bool> decided{ false };
+
+    // Batches played ahead of the test wait here, by their first game,
+    // until the ones before them are in.
+    std::mutex mutex;
+    std::map<int64, std::vector<GameResult>> waiting;
+    int64 next_batch = 0;
+
+    auto add_pair = [&](
+        const GameResult& a,
+        const GameResult& b)
+    {
+        match.m_stats[0].add(a);
+        match.m_stats[1].add(b);
+        if (a.m_won == b.m_won)
+            return false;
+
+        match.m_only_won[a.m_won ? 0 : 1]++;
+        match.m_llr += a.m_won ? step : -step;
+        if (match.m_llr >= upper)
+        {
+            match.m_decision = sd_FirstBetter;
+        }
+        else if (match.m_llr <= lower)
+        {
+            match.m_decision = sd_SecondBetter;
+        }
+        return match.m_decision != sd_Inconclusive;
+    };
+
+    auto worker = [&]
+    {
+        auto dungeon = m_simulator.make_dungeon();
+        while (!decided)
+        {
+            int64 first_game = next_game.fetch_add(batch_size);
+            if (first_game >= settings.m_games)
+                break;
+
+            // The two results of game i side by side.
+            std::vector<GameResult> results;
+            int64 last_game = std::min(first_game + batch_size, settings.m_games);
+            for (int64 game_index = first_game; game_index < last_game; game_index++)
+            {
+                results.push_back(m_simulator.play_game(*dungeon, game_index, first));
+                results.push_back(m_simulator.play_game(*dungeon, game_index, second));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            waiting.emplace(first_game, std::move(results));
+            for (auto batch = waiting.find(next_batch); batch != waiting.end() && !decided; batch = waiting.find(next_batch))
+            {
+                for (size_t i = 0; i < batch->second.size() && !decided; i += 2)
+                {
+                    decided = add_pair(batch->second[i], batch->second[i + 1]);
+                }
+
+                waiting.erase(batch);
+                next_batch += batch_size;
+            }
+        }
+    };
+
+    int32 thread_count = settings.m_threads > 0 ?
+        settings.m_threads :
+        std::max(1, (int32)std::thread::hardware_concurrency());
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> thread_pool;
+    for (int32 i = 1; i < thread_count; i++)
+    {
+        thread_pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : thread_pool)
+    {
+        thread.join();
+    }
+
+    match.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    match.m_stats[0].m_seconds = match.m_seconds;
+    match.m_stats[1].m_seconds = match.m_seconds;
+    return match;
+}
+
+template <int32 Width, int32 Height, typename Topology>
+std::vector<MatchResult> Tournament<Width, Height, Topology>::run(
+    const std::vector<const MovePolicy*>& policies) const
+{
+    std::vector<MatchResult> matches;
+    for (size_t i = 0; i < policies.size(); i++)
+    {
+        for (size_t j = i + 1; j < policies.size(); j++)
+        {
+            matches.push_back(play_match(*policies[i], *policies[j]));
+        }
+    }
+    return matches;
+}
+
+template class Tournament<dungeon_size, dungeon_size, Torus>;
+template class Tournament<dynamic_size, dynamic_size, Torus>;
+template class Tournament<dungeon_size, dungeon_size, WalledGrid>;
+template class Tournament<dynamic_size, dynamic_size, WalledGrid>;
+template class Tournament<dungeon_size, dungeon_size, HexGrid>;
+template class Tournament<dynamic_size, dynamic_size, HexGrid>;
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include "simulator.h"
+
+//////////////////////////////
+// SprtSettings
+//////////////////////////////
+
+// A sequential probability ratio test on the pairs of games where one
+// policy won and the other did not. With p the share of those pairs the
+// first policy wins, it tests p = 0.5 - margin against p = 0.5 + margin,
+// and stops once the log likelihood ratio leaves the bounds alpha and
+// beta give.
+struct SprtSettings
+{
+    double m_alpha = 0.05;          // chance of calling the first better when the second is
+    double m_beta = 0.05;           // chance of calling the second better when the first is
+    double m_margin = 0.05;
+};
+
+enum SprtDecision
+{
+    sd_FirstBetter,
+    sd_SecondBetter,
+    sd_Inconclusive,                // the games ran out first
+
+    sd__Count
+};
+
+//////////////////////////////
+// MatchResult
+//////////////////////////////
+
+struct MatchResult
+{
+    const MovePolicy* m_policies[2]{};
+    SimulationStats m_stats[2];     // games up to the decision
+    int64 m_only_won[2]{};          // pairs only this policy won
+    double m_llr = 0.0;
+    SprtDecision m_decision = sd_Inconclusive;
+    double m_seconds = 0.0;
+};
+
+//////////////////////////////
+// Tournament class
+//////////////////////////////
+
+// Pits policies against each other on a Simulator, both policies of a
+// match playing game i of the run on the same hidden dungeon. Pairs are
+// played on all threads and fed to the test in game order, so a match
+// stops on the same game and reports the same numbers whatever the
+// thread count; pairs past the decision are thrown away. A match plays
+// no more than the simulator settings' game count, and none on a board
+// the simulator does not play.
+template <int32 Width = dungeon_size, int32 Height = Width, typename Topology = Torus>
+class Tournament
+{
+public:
+    Tournament(
+        const SimulatorSettings& settings,
+        const SprtSettings& sprt);
+
+    MatchResult play_match(
+        const MovePolicy& first,
+        const MovePolicy& second) const;
+
+    // Every policy against every later one.
+    std::vector<MatchResult> run(
+        const std::vector<const MovePolicy*>& policies) const;
+
+private:
+    static constexpr int64 batch_size = 64;
+
+    Simulator<Width, Height, Topology> m_simulator;
+    SprtSettings m_sprt;
+};
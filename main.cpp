@@ -112,6 +112,9 @@ int WinMain(
     // Our state
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    // The last session is read before the window shows anything of it.
+    companion_load();
+
     // Main loop
     MSG msg;
     ZeroMemory(&msg, sizeof(msg));
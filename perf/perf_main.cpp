@@ -0,0 +1,866 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "companion/companion.h"
+#include "companion/simulator.h"
+#include "companion/snapshot_arena.h"
+#include "imgui.h"
+
+// Timings of the dungeon and of the frames the companion draws, taken
+// without a window and printed as JSON.
+//
+//   companion_perf [--filter TEXT] [--out FILE] [--baseline FILE] [--threshold PERCENT]
+//
+// Benchmarks are named kind/function/board/position and give the median
+// and the fastest of their samples, in nanoseconds per operation.
+//
+// dungeon: update_room_states(), explore(), get_room(), Dungeon::draw()
+// and Room::draw() on Dungeons, at positions of a canned replay from the
+// empty board to late in the game. what_if makes each of the replay's
+// next moves from the position in turn, headless, keeping the boards
+// they lead to in a SnapshotArena. Boards up to 11x11 fit in a Bitboard,
+// the larger ones up to 128x128 are derived room by room.
+// rooms: the room rules and Room::draw() on RoomStores alone, whose boards
+// go up to 1000x1000, with a share of the empty rooms visited.
+// frame: whole companion_draw() frames as main.cpp draws them, idle at the
+// replay's positions and while the replay is keyed in. The companion
+// keeps its session and log in a scratch directory of the run's own,
+// removed at exit.
+//
+// --filter runs the benchmarks whose name contains the text. --baseline
+// compares the medians with a file --out wrote before and lists those
+// slower by more than the threshold, 10% by default, exiting with 2 if
+// there are any.
+
+constexpr int32 perf_samples = 7;
+constexpr std::chrono::milliseconds perf_sample_time{ 20 };
+constexpr uint64 perf_seed = 0x5EED;
+constexpr int32 perf_hazard_counts[a__Count]{ 8, 4, 1 };
+constexpr int32 perf_large_sizes[]{ 10, 100, 1000 };
+constexpr int32 perf_large_dungeon_sizes[]{ 16, 32, 64, 128 };
+constexpr int32 perf_idle_frames = 200;
+constexpr int32 perf_what_if_moves = 8;
+constexpr double perf_default_threshold = 0.1;
+
+// The companion's room sizes at a window scale of 1.
+constexpr float perf_room_screen_size = 52.f;
+constexpr float perf_room_font_size_mult = 0.28f;
+
+// Virtual key codes, as the Win32 backend fills io.KeysDown.
+constexpr int32 perf_key_left = 0x25;
+constexpr int32 perf_key_up = 0x26;
+constexpr int32 perf_key_right = 0x27;
+constexpr int32 perf_key_down = 0x28;
+constexpr char perf_warning_keys[a__Count]{ 'P', 'A', 'D' };
+
+using PerfClock = std::chrono::steady_clock;
+
+extern float room_screen_size;
+extern float room_font_size_mult;
+
+// Results of the timed loops go here so that they are not optimized away.
+int64 perf_sink = 0;
+
+// Where the companion keeps its session and log during the run.
+std::filesystem::path perf_scratch;
+
+//////////////////////////////
+// PerfPosition
+//////////////////////////////
+
+struct PerfPosition
+{
+    const char* m_name;
+    float m_progress;       // share of the replay's moves made, or of the empty rooms visited
+};
+
+constexpr PerfPosition perf_positions[]
+{
+    { "empty", 0.f },
+    { "early", 0.25f },
+    { "mid", 0.5f },
+    { "late", 0.9f },
+};
+
+//////////////////////////////
+// PerfSuite
+//////////////////////////////
+
+struct PerfResult
+{
+    std::string m_name;
+    double m_ns_per_op = 0.0;       // median of the samples
+    double m_min_ns_per_op = 0.0;
+    int64 m_ops = 0;
+};
+
+class PerfSuite
+{
+public:
+    PerfSuite(
+        const std::string& filter) :
+        m_filter(filter)
+    {
+    }
+
+    bool wants(
+        const std::string& name) const { return name.find(m_filter) != std::string::npos; }
+
+    // step() does ops operations and returns how long they took, so that
+    // it can set them up untimed. Each sample steps until its time is up.
+    template <typename Step>
+    void measure(
+        const std::string& name,
+        const int64 ops,
+        Step&& step)
+    {
+        if (!wants(name))
+            return;
+
+        std::vector<double> samples;
+        int64 total_ops = 0;
+        for (int32 i = 0; i < perf_samples; i++)
+        {
+            std::chrono::nanoseconds elapsed{ 0 };
+            int64 sample_ops = 0;
+            auto start = PerfClock::now();
+            do
+            {
+                elapsed += step();
+                sample_ops += ops;
+            } while (PerfClock::now() - start < perf_sample_time);
+
+            samples.push_back(double(elapsed.count()) / sample_ops);
+            total_ops += sample_ops;
+        }
+        add(name, samples, total_ops);
+    }
+
+    // Samples the caller took, in nanoseconds per operation.
+    void add(
+        const std::string& name,
+        std::vector<double> samples,
+        const int64 ops)
+    {
+        if (!wants(name) || samples.empty())
+            return;
+
+        std::sort(samples.begin(), samples.end());
+        m_results.push_back({ name, samples[samples.size() / 2], samples.front(), ops });
+        fprintf(stderr, "%-48s %12.1f ns\n", name.c_str(), m_results.back().m_ns_per_op);
+    }
+
+    const std::vector<PerfResult>& get_results() const { return m_results; }
+
+private:
+    std::string m_filter;
+    std::vector<PerfResult> m_results;
+};
+
+//////////////////////////////
+// Canned replays
+//////////////////////////////
+
+struct PerfMove
+{
+    int32 m_room;           // room index
+    uint8 m_warnings;       // a bit per attribute, as le_Explore has them
+};
+
+// A careful and lucky player's game: from the start room the player only
+// ever enters rooms next to visited ones that hold no hazard, picked at
+// random, until there are none left.
+std::vector<PerfMove> make_replay(
+    const BoardGeometry& geometry,
+    const uint64 seed)
+{
+    SimulatorRng rng = make_game_rng(seed, 0);
+    HiddenDungeon hidden = generate_dungeon(geometry, perf_hazard_counts, rng);
+
+    Bitboard empty = geometry.all();
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        empty &= ~hidden.m_hazards[a];
+    }
+
+    std::vector<PerfMove> replay;
+    Bitboard visited;
+    Bitboard next;
+    next.set(hidden.m_start);
+    while (next.any())
+    {
+        int32 index = pick_room(next, rng);
+        visited.set(index);
+        replay.push_back({ index, get_warnings(hidden, geometry, index) });
+
+        next = geometry.neighbors_of(visited) & empty & ~visited;
+    }
+    return replay;
+}
+
+// The same game on a board too big for a Bitboard, with hazards placed
+// room by room as densely as on the handheld's board.
+template <typename Topology>
+std::vector<PerfMove> make_large_replay(
+    const int32 width,
+    const int32 height,
+    const uint64 seed)
+{
+    RoomStore<dynamic_size, dynamic_size, Topology> store(width, height);
+    int32 room_count = store.get_room_count();
+
+    SimulatorRng rng = make_game_rng(seed, room_count);
+    std::uniform_real_distribution<float> chance(0.f, 1.f);
+
+    std::vector<uint8> hazards(room_count);
+    std::vector<int32> empty;
+    for (int32 index = 0; index < room_count; index++)
+    {
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            if (chance(rng) * (dungeon_size * dungeon_size) < perf_hazard_counts[a])
+                hazards[index] |= 1 << a;
+        }
+
+        if (hazards[index] == 0)
+            empty.push_back(index);
+    }
+
+    std::vector<PerfMove> replay;
+    if (empty.empty())
+        return replay;
+
+    // Empty rooms next to visited ones, and whether a room ever was.
+    std::vector<int32> next{ empty[std::uniform_int_distribution<size_t>(0, empty.size() - 1)(rng)] };
+    std::vector<bool> reached(room_count);
+    reached[next[0]] = true;
+    while (!next.empty())
+    {
+        size_t pick = std::uniform_int_distribution<size_t>(0, next.size() - 1)(rng);
+        int32 index = next[pick];
+        next[pick] = next.back();
+        next.pop_back();
+
+        uint8 warnings = 0;
+        for (int32 neighbor : store.get_neighbors(index))
+        {
+            if (store.is_wall(neighbor))
+                continue;
+
+            warnings |= hazards[neighbor];
+            if (hazards[neighbor] == 0 && !reached[neighbor])
+            {
+                reached[neighbor] = true;
+                next.push_back(neighbor);
+            }
+        }
+        replay.push_back({ index, warnings });
+    }
+    return replay;
+}
+
+//////////////////////////////
+// Drawing
+//////////////////////////////
+
+// Runs draw() inside a window of a frame and returns how long it took.
+template <typename Draw>
+std::chrono::nanoseconds time_in_window(
+    Draw&& draw)
+{
+    ImGui::NewFrame();
+    ImGui::Begin("Perf");
+
+    auto start = PerfClock::now();
+    draw();
+    std::chrono::nanoseconds elapsed = PerfClock::now() - start;
+
+    ImGui::End();
+    ImGui::EndFrame();
+    return elapsed;
+}
+
+// Draws one row of rooms into a draw list of its own, laid out as
+// Dungeon::draw() does on a square board. Nothing is clipped, so every
+// room is drawn in full wherever it is.
+template <typename PerfRoom>
+std::chrono::nanoseconds draw_row(
+    const std::vector<PerfRoom>& rooms,
+    const int32 width,
+    const int32 y,
+    ImDrawList& draw_list)
+{
+    draw_list.Clear();
+    draw_list.PushClipRect({ -FLT_MAX, -FLT_MAX }, { FLT_MAX, FLT_MAX });
+    draw_list.PushTextureID(ImGui::GetIO().Fonts->TexID);
+
+    auto start = PerfClock::now();
+    for (int32 x = 0; x < width; x++)
+    {
+        ImVec2 pos{ (x + 0.5f) * room_screen_size, (y + 0.5f) * room_screen_size };
+        perf_sink += rooms[y * width + x].draw(100, pos, draw_list);
+    }
+    return PerfClock::now() - start;
+}
+
+// Room::draw() for every room in turn, a row per step.
+template <typename PerfRoom>
+void measure_room_draw(
+    PerfSuite& suite,
+    const std::string& name,
+    const std::vector<PerfRoom>& rooms,
+    const int32 width)
+{
+    if (!suite.wants(name))
+        return;
+
+    // Rooms ask ImGui whether the mouse is over them, so a frame is on.
+    ImGui::NewFrame();
+    ImDrawList draw_list(ImGui::GetDrawListSharedData());
+    int32 row = 0;
+    int32 height = (int32)rooms.size() / width;
+    suite.measure(name, width, [&]
+    {
+        row = (row + 1) % height;
+        return draw_row(rooms, width, row, draw_list);
+    });
+    ImGui::EndFrame();
+}
+
+//////////////////////////////
+// Benchmarks
+//////////////////////////////
+
+template <int32 Width, int32 Height, typename Topology>
+void bench_dungeon(
+    PerfSuite& suite,
+    Dungeon<Width, Height, Topology>& dungeon)
+{
+    using PerfRoom = typename Dungeon<Width, Height, Topology>::DungeonRoom;
+
+    int32 width = dungeon.get_width();
+    int32 height = dungeon.get_height();
+    std::string board = std::to_string(width) + "x" + std::to_string(height);
+
+    std::vector<PerfMove> replay = dungeon.has_bitboards() ?
+        make_replay(BoardGeometry(Topology{}, width, height), perf_seed) :
+        make_large_replay<Topology>(width, height, perf_seed);
+    if (replay.empty())
+        return;
+
+    auto get_pos = [width](
+        const PerfMove& move)
+    {
+        return ivec2{ move.m_room % width, move.m_room / width };
+    };
+
+    for (const PerfPosition& position : perf_positions)
+    {
+        std::string suffix = "/" + board + "/" + position.m_name;
+
+        int32 moves = (int32)(position.m_progress * replay.size());
+        dungeon.reset();
+        dungeon.clear_history();
+        for (int32 i = 0; i < moves; i++)
+        {
+            const PerfMove& move = replay[i];
+            dungeon.select_room(get_pos(move));
+            dungeon.explore(move.m_warnings & 1, (move.m_warnings >> 1) & 1, (move.m_warnings >> 2) & 1);
+        }
+        DungeonSnapshot snapshot = dungeon.get_snapshot();
+
+        suite.measure("dungeon/update_room_states" + suffix, 1, [&]
+        {
+            auto start = PerfClock::now();
+            dungeon.update_room_states();
+            return PerfClock::now() - start;
+        });
+
+        // The replay's next move, made again from the position each time.
+        // Boards without snapshots take it back with retract_observation()
+        // instead, which derives all their rooms again.
+        ivec2 next_room = get_pos(replay[moves]);
+        uint8 warnings = replay[moves].m_warnings;
+        suite.measure("dungeon/explore" + suffix, 1, [&]
+        {
+            dungeon.restore_snapshot(snapshot);
+            dungeon.clear_history();
+            dungeon.select_room(next_room);
+
+            auto start = PerfClock::now();
+            dungeon.explore(warnings & 1, (warnings >> 1) & 1, (warnings >> 2) & 1);
+            std::chrono::nanoseconds elapsed = PerfClock::now() - start;
+
+            if (!dungeon.has_bitboards())
+            {
+                dungeon.retract_observation(next_room);
+            }
+            return elapsed;
+        });
+        dungeon.restore_snapshot(snapshot);
+        dungeon.clear_history();
+
+        // The position stays in the arena under the boards that follow it.
+        if (dungeon.has_bitboards())
+        {
+            SnapshotArena<DungeonSnapshot, perf_what_if_moves + 1> arena;
+            int32 what_ifs = std::min(perf_what_if_moves, (int32)replay.size() - moves);
+            suite.measure("dungeon/what_if" + suffix, what_ifs, [&]
+            {
+                arena.clear();
+                SnapshotId position_id = arena.push(snapshot);
+                dungeon.set_headless(true);
+
+                auto start = PerfClock::now();
+                for (int32 i = 0; i < what_ifs; i++)
+                {
+                    const PerfMove& move = replay[moves + i];
+                    dungeon.restore_snapshot(arena.get(position_id));
+                    dungeon.select_room(get_pos(move));
+                    dungeon.explore(move.m_warnings & 1, (move.m_warnings >> 1) & 1, (move.m_warnings >> 2) & 1);
+                    arena.push(dungeon.get_snapshot());
+                }
+                std::chrono::nanoseconds elapsed = PerfClock::now() - start;
+
+                perf_sink += arena.get_size();
+                dungeon.clear_history();
+                dungeon.set_headless(false);
+                return elapsed;
+            });
+            dungeon.restore_snapshot(snapshot);
+            dungeon.clear_history();
+        }
+
+        suite.measure("dungeon/get_room" + suffix, width * height, [&]
+        {
+            int32 pits = 0;
+            auto start = PerfClock::now();
+            for (int32 y = 0; y < height; y++)
+            {
+                for (int32 x = 0; x < width; x++)
+                {
+                    pits += dungeon.get_room({ x, y }).get_room_state(a_Pit) == rs_Yes;
+                }
+            }
+            std::chrono::nanoseconds elapsed = PerfClock::now() - start;
+            perf_sink += pits;
+            return elapsed;
+        });
+
+        suite.measure("dungeon/draw" + suffix, 1, [&]
+        {
+            return time_in_window([&] { dungeon.draw(); });
+        });
+
+        std::vector<PerfRoom> rooms;
+        for (int32 y = 0; y < height; y++)
+        {
+            for (int32 x = 0; x < width; x++)
+            {
+                rooms.push_back(dungeon.get_room({ x, y }));
+            }
+        }
+        measure_room_draw(suite, "dungeon/room_draw" + suffix, rooms, width);
+    }
+}
+
+// Hazards as dense as on the handheld's board, warnings entered right.
+void bench_rooms(
+    PerfSuite& suite,
+    const int32 size)
+{
+    using PerfStore = RoomStore<dynamic_size, dynamic_size, Torus>;
+    using PerfRoom = Room<dynamic_size, dynamic_size, Torus>;
+
+    std::string board = std::to_string(size) + "x" + std::to_string(size);
+
+    PerfStore store(size, size);
+    int32 room_count = store.get_room_count();
+
+    SimulatorRng rng = make_game_rng(perf_seed, size);
+    std::uniform_real_distribution<float> chance(0.f, 1.f);
+
+    // A room is visited at every position past its share, so that later
+    // positions take up earlier ones whichever of them are run.
+    std::vector<uint8> hazards(room_count);
+    std::vector<float> visit_share(room_count);
+    for (int32 index = 0; index < room_count; index++)
+    {
+        visit_share[index] = chance(rng);
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            if (chance(rng) * (dungeon_size * dungeon_size) < perf_hazard_counts[a])
+                hazards[index] |= 1 << a;
+        }
+    }
+
+    std::vector<PerfRoom> rooms;
+    for (int32 index = 0; index < room_count; index++)
+    {
+        rooms.emplace_back(store, index);
+    }
+
+    auto update_rooms = [&]
+    {
+        for (PerfRoom& room : rooms)
+        {
+            room.update_room_state_no();
+        }
+        for (PerfRoom& room : rooms)
+        {
+            room.update_room_state_maybe_yes();
+        }
+    };
+
+    for (const PerfPosition& position : perf_positions)
+    {
+        std::string suffix = "/" + board + "/" + position.m_name;
+        if (!suite.wants("rooms/update_room_states" + suffix) && !suite.wants("rooms/room_draw" + suffix))
+            continue;
+
+        store.reset();
+        for (int32 index = 0; index < room_count; index++)
+        {
+            if (hazards[index] != 0 || visit_share[index] >= position.m_progress)
+                continue;
+
+            uint8 warnings = 0;
+            for (int32 neighbor : store.get_neighbors(index))
+            {
+                warnings |= hazards[neighbor];
+            }
+
+            store.set_visited(index, true);
+            for (int32 a = 0; a < a__Count; a++)
+            {
+                store.set_room_state(index, (Attribute)a, rs_No);
+                store.set_neighbor_state(index, (Attribute)a, (warnings >> a) & 1 ? ns_Yes : ns_No);
+            }
+        }
+        update_rooms();
+
+        suite.measure("rooms/update_room_states" + suffix, room_count, [&]
+        {
+            auto start = PerfClock::now();
+            update_rooms();
+            return PerfClock::now() - start;
+        });
+
+        measure_room_draw(suite, "rooms/room_draw" + suffix, rooms, size);
+    }
+}
+
+// Keys in the canned replay on the companion's own board, a frame with
+// each key down and one with it up again.
+void bench_frames(
+    PerfSuite& suite)
+{
+    std::string prefix = "frame/companion_draw/" + std::to_string(dungeon_size) + "x" + std::to_string(dungeon_size) + "/";
+    bool wanted = suite.wants(prefix + "replay");
+    for (const PerfPosition& position : perf_positions)
+    {
+        wanted |= suite.wants(prefix + position.m_name);
+    }
+    if (!wanted)
+        return;
+
+    ImGuiIO& io = ImGui::GetIO();
+    auto draw_frame = []
+    {
+        auto start = PerfClock::now();
+        ImGui::NewFrame();
+        companion_draw();
+        ImGui::Render();
+        return std::chrono::nanoseconds(PerfClock::now() - start);
+    };
+
+    std::vector<double> input_frames;
+    auto press = [&](
+        const int32 key)
+    {
+        io.KeysDown[key] = true;
+        input_frames.push_back(double(draw_frame().count()));
+        io.KeysDown[key] = false;
+        input_frames.push_back(double(draw_frame().count()));
+    };
+
+    // As main.cpp does before its first frame. That frame sets up the
+    // windows and is not timed either.
+    companion_load();
+    draw_frame();
+
+    BoardGeometry geometry(Torus{}, dungeon_size, dungeon_size);
+    std::vector<PerfMove> replay = make_replay(geometry, perf_seed);
+    int32 move_count = (int32)replay.size();
+
+    ivec2 selected{ 0, 0 };
+    bool warning_checked[a__Count]{};
+    int32 moves = 0;
+    for (const PerfPosition& position : perf_positions)
+    {
+        for (; moves < (int32)(position.m_progress * move_count); moves++)
+        {
+            int32 room = replay[moves].m_room;
+            ivec2 target{ room % dungeon_size, room / dungeon_size };
+
+            // The shorter way round the torus.
+            int32 right = (target.x - selected.x + dungeon_size) % dungeon_size;
+            int32 down = (target.y - selected.y + dungeon_size) % dungeon_size;
+            for (int32 i = 0; i < std::min(right, dungeon_size - right); i++)
+            {
+                press(right <= dungeon_size / 2 ? perf_key_right : perf_key_left);
+            }
+            for (int32 i = 0; i < std::min(down, dungeon_size - down); i++)
+            {
+                press(down <= dungeon_size / 2 ? perf_key_down : perf_key_up);
+            }
+            selected = target;
+
+            uint8 warnings = replay[moves].m_warnings;
+            for (int32 a = 0; a < a__Count; a++)
+            {
+                bool warning = (warnings >> a) & 1;
+                if (warning_checked[a] != warning)
+                {
+                    press(perf_warning_keys[a]);
+                    warning_checked[a] = warning;
+                }
+            }
+            press(' ');
+        }
+
+        std::vector<double> idle_frames;
+        for (int32 i = 0; i < perf_idle_frames; i++)
+        {
+            idle_frames.push_back(double(draw_frame().count()));
+        }
+        suite.add(prefix + position.m_name, idle_frames, perf_idle_frames);
+    }
+    suite.add(prefix + "replay", input_frames, (int64)input_frames.size());
+}
+
+//////////////////////////////
+// JSON
+//////////////////////////////
+
+void write_json(
+    FILE* file,
+    const std::vector<PerfResult>& results)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const PerfResult& result = results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"ops\": %lld }%s\n",
+            result.m_name.c_str(),
+            result.m_ns_per_op,
+            result.m_min_ns_per_op,
+            (long long)result.m_ops,
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+// Medians by name, from a file write_json() wrote: a benchmark a line.
+bool read_baseline(
+    const std::filesystem::path& path,
+    std::map<std::string, double>& baseline)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    const std::string name_key = "\"name\": \"";
+    const std::string time_key = "\"ns_per_op\": ";
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t name = line.find(name_key);
+        size_t time = line.find(time_key);
+        if (name == std::string::npos || time == std::string::npos)
+            continue;
+
+        name += name_key.size();
+        baseline[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + time + time_key.size());
+    }
+    return true;
+}
+
+// Lists the benchmarks slower than the baseline by more than the
+// threshold, returns how many.
+int32 compare_with_baseline(
+    const std::vector<PerfResult>& results,
+    const std::map<std::string, double>& baseline,
+    const double threshold)
+{
+    int32 compared = 0;
+    int32 regressions = 0;
+    for (const PerfResult& result : results)
+    {
+        auto base = baseline.find(result.m_name);
+        if (base == baseline.end() || base->second <= 0.0)
+            continue;
+
+        compared++;
+        double change = result.m_ns_per_op / base->second - 1.0;
+        if (change > threshold)
+        {
+            fprintf(stderr, "regression: %-40s %12.1f -> %12.1f ns (%+.1f%%)\n",
+                result.m_name.c_str(),
+                base->second,
+                result.m_ns_per_op,
+                100.0 * change);
+            regressions++;
+        }
+    }
+
+    fprintf(stderr, "%d of %d benchmarks slower than the baseline by more than %.0f%%\n", regressions, compared, 100.0 * threshold);
+    return regressions;
+}
+
+//////////////////////////////
+// Main entry point
+//////////////////////////////
+
+// At exit, after the companion wrote its session and log for the last
+// time, as it is destroyed before functions registered ahead of it run.
+void remove_scratch()
+{
+    std::error_code error;
+    std::filesystem::current_path(std::filesystem::temp_directory_path(error), error);
+    std::filesystem::remove_all(perf_scratch, error);
+}
+
+void print_usage()
+{
+    printf("usage: companion_perf [--filter TEXT] [--out FILE] [--baseline FILE] [--threshold PERCENT]\n");
+}
+
+int main(
+    int argc,
+    char** argv)
+{
+    std::string filter;
+    std::filesystem::path out_path;
+    std::filesystem::path baseline_path;
+    double threshold = perf_default_threshold;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--filter") && has_value)
+        {
+            filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--out") && has_value)
+        {
+            out_path = std::filesystem::absolute(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--baseline") && has_value)
+        {
+            baseline_path = std::filesystem::absolute(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--threshold") && has_value)
+        {
+            threshold = std::max(0.0, atof(argv[++i]) / 100.0);
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !read_baseline(baseline_path, baseline))
+    {
+        fprintf(stderr, "cannot read %s\n", baseline_path.string().c_str());
+        return 1;
+    }
+
+    // The companion's session and log, started afresh in a directory no
+    // other run uses.
+    std::error_code error;
+    std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+    std::random_device random;
+    do
+    {
+        perf_scratch = temp / ("companion_perf_" + std::to_string(random()));
+    } while (!error && !std::filesystem::create_directory(perf_scratch, error));
+
+    if (!error)
+    {
+        std::atexit(remove_scratch);
+        std::filesystem::current_path(perf_scratch, error);
+    }
+
+    if (error)
+    {
+        fprintf(stderr, "cannot use %s\n", perf_scratch.string().c_str());
+        return 1;
+    }
+
+    ImGui::CreateContext();
+    ImGui::StyleColorsDark();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = { 933.f, 656.f };
+    io.DeltaTime = 1.f / 60.f;
+    io.MousePos = { -FLT_MAX, -FLT_MAX };
+    io.KeyMap[ImGuiKey_LeftArrow] = perf_key_left;
+    io.KeyMap[ImGuiKey_UpArrow] = perf_key_up;
+    io.KeyMap[ImGuiKey_RightArrow] = perf_key_right;
+    io.KeyMap[ImGuiKey_DownArrow] = perf_key_down;
+
+    unsigned char* pixels;
+    int width;
+    int height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    room_screen_size = perf_room_screen_size;
+    room_font_size_mult = perf_room_font_size_mult;
+
+    PerfSuite suite(filter);
+    {
+        Dungeon<> dungeon;
+        bench_dungeon(suite, dungeon);
+    }
+    {
+        Dungeon<dynamic_size, dynamic_size> dungeon(11, 11);
+        bench_dungeon(suite, dungeon);
+    }
+    for (int32 size : perf_large_dungeon_sizes)
+    {
+        Dungeon<dynamic_size, dynamic_size> dungeon(size, size);
+        bench_dungeon(suite, dungeon);
+    }
+    for (int32 size : perf_large_sizes)
+    {
+        bench_rooms(suite, size);
+    }
+    bench_frames(suite);
+
+    FILE* out = out_path.empty() ? stdout : fopen(out_path.string().c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s\n", out_path.string().c_str());
+        return 1;
+    }
+    write_json(out, suite.get_results());
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    int32 regressions = baseline_path.empty() ? 0 : compare_with_baseline(suite.get_results(), baseline, threshold);
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "companion/tournament.h"
+
+// Plays random games on the handheld's board without a window and
+// reports how they went.
+//
+//   companion_sim [--games N] [--threads N] [--seed N] [--fatal-pits] [--lanes | --tournament]
+//
+// --lanes plays on a LaneSimulator, with the room rules alone, instead of
+// on Dungeons.
+//
+// --tournament plays every policy against every other on the same
+// dungeons until a test tells which wins more, --games bounding each
+// match.
+//
+// Guesses are moves the deductions left no room known to be empty for,
+// the share of them is what engine changes should bring down.
+
+void print_usage()
+{
+    printf("usage: companion_sim [--games N] [--threads N] [--seed N] [--fatal-pits] [--lanes | --tournament]\n");
+}
+
+void print_stats(
+    const char* policy_name,
+    const SimulationStats& stats)
+{
+    const char* death_labels[a__Count]{ "pit", "arrow", "dragon" };
+
+    double games = (double)std::max<int64>(stats.m_games, 1);
+    double moves = (double)std::max<int64>(stats.m_moves, 1);
+    double wins = (double)std::max<int64>(stats.m_wins, 1);
+
+    printf("%s: %lld games in %.2f s\n", policy_name, (long long)stats.m_games, stats.m_seconds);
+    printf("  games/minute          %10.0f\n", stats.m_games * 60.0 / std::max(stats.m_seconds, 1e-9));
+    printf("  won                   %9.2f%%\n", 100.0 * stats.m_wins / games);
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        printf("  killed by %-6s      %9.2f%%\n", death_labels[a], 100.0 * stats.m_deaths[a] / games);
+    }
+    printf("  stuck                 %9.2f%%\n", 100.0 * stats.m_stuck / games);
+    printf("  moves/game            %10.2f\n", stats.m_moves / games);
+    printf("  moves/win             %10.2f\n", stats.m_won_moves / wins);
+    printf("  guessed moves         %9.2f%%\n", 100.0 * stats.m_guesses / moves);
+    printf("  games with a guess    %9.2f%%\n", 100.0 * stats.m_guessed_games / games);
+}
+
+void print_match(
+    const MatchResult& match)
+{
+    const char* first = match.m_policies[0]->get_name();
+    const char* second = match.m_policies[1]->get_name();
+
+    printf("%s vs %s: ", first, second);
+    switch (match.m_decision)
+    {
+    case sd_FirstBetter:
+        printf("%s wins more", first);
+        break;
+    case sd_SecondBetter:
+        printf("%s wins more", second);
+        break;
+    default:
+        printf("no decision");
+        break;
+    }
+    printf(" after %lld games (LLR %.2f, %lld to %lld games only one won)\n",
+        (long long)match.m_stats[0].m_games,
+        match.m_llr,
+        (long long)match.m_only_won[0],
+        (long long)match.m_only_won[1]);
+
+    for (int32 i = 0; i < 2; i++)
+    {
+        print_stats(match.m_policies[i]->get_name(), match.m_stats[i]);
+    }
+}
+
+int main(
+    int argc,
+    char** argv)
+{
+    SimulatorSettings settings;
+    bool lanes = false;
+    bool tournament = false;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--games") && has_value)
+        {
+            settings.m_games = std::max(1ll, atoll(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--threads") && has_value)
+        {
+            settings.m_threads = std::max(0, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--seed") && has_value)
+        {
+            settings.m_seed = strtoull(argv[++i], nullptr, 0);
+        }
+        else if (!strcmp(argv[i], "--fatal-pits"))
+        {
+            settings.m_fatal_pits = true;
+        }
+        else if (!strcmp(argv[i], "--lanes"))
+        {
+            lanes = true;
+        }
+        else if (!strcmp(argv[i], "--tournament"))
+        {
+            tournament = true;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (lanes && tournament)
+    {
+        print_usage();
+        return 1;
+    }
+
+    RandomSafePolicy policy;
+    if (tournament)
+    {
+        NearestSafePolicy nearest;
+        InformationGainPolicy information;
+
+        Tournament<> round_robin(settings, SprtSettings{});
+        for (const MatchResult& match : round_robin.run({ &policy, &nearest, &information }))
+        {
+            print_match(match);
+        }
+    }
+    else if (lanes)
+    {
+        LaneSimulator simulator(BoardGeometry(Torus{}, dungeon_size, dungeon_size), settings);
+        print_stats(policy.get_name(), simulator.run(policy));
+    }
+    else
+    {
+        Simulator<> simulator(settings);
+        print_stats(policy.get_name(), simulator.run(policy));
+    }
+    return 0;
+}
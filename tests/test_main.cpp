@@ -0,0 +1,550 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include "companion/simulator.h"
+
+// Checks what the engines promise against the slow way of getting the
+// same answer, on games the simulator's dungeons and policy play.
+//
+//   companion_test
+//
+// Each failed check is printed; the exit code is 1 if any failed.
+
+using TestDungeon = Dungeon<>;
+
+constexpr uint64 test_seed = 0x7E57;
+constexpr int32 test_games = 64;
+constexpr int32 test_max_moves = 60;
+
+const BoardGeometry test_geometry(Torus{}, dungeon_size, dungeon_size);
+const int32 test_hazard_counts[a__Count]{ 8, 4, 1 };
+
+int32 test_failures = 0;
+
+void check(
+    const bool passed,
+    const char* test_name,
+    const char* what,
+    const int64 game_index)
+{
+    if (passed)
+        return;
+
+    printf("FAILED %s: %s (game %lld)\n", test_name, what, (long long)game_index);
+    test_failures++;
+}
+
+//////////////////////////////
+// Games
+//////////////////////////////
+
+// The settings bits of Dungeon::get_settings(), each test runs under all
+// of them.
+struct TestSettings
+{
+    const char* m_name;
+    uint8 m_settings;
+};
+
+const TestSettings test_settings[]
+{
+    { "local rules", 1 << 5 },
+    { "chain", 1 | 1 << 5 },
+    { "complete", 1 | 1 << 1 | 1 << 5 },
+    { "complete with counts", 1 | 1 << 1 | 1 << 3 | 1 << 4 | 1 << 5 },
+};
+
+// The local rules alone stop short of a fixpoint, so what they derive
+// depends on the order the observations came in. With chain deductions
+// it does not.
+bool is_order_free(
+    const TestSettings& settings)
+{
+    return (settings.m_settings & 1) != 0;
+}
+
+std::unique_ptr<TestDungeon> make_dungeon(
+    const TestSettings& settings)
+{
+    auto dungeon = std::make_unique<TestDungeon>(1);
+    dungeon->set_headless(true);
+
+    LogEvent event{ .m_type = le_Settings, .m_settings = settings.m_settings, .m_error_rate = BeliefSettings{}.m_error_rate };
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        event.m_hazard_counts[a] = (uint8)test_hazard_counts[a];
+    }
+    dungeon->apply(event);
+    return dungeon;
+}
+
+ivec2 get_room_pos(
+    const int32 index)
+{
+    return { index % test_geometry.width(), index / test_geometry.width() };
+}
+
+// Plays a game the way the Simulator does, with on_move called after each
+// move the board took. Returns how many that was.
+template <typename OnMove>
+int32 play_game(
+    TestDungeon& dungeon,
+    const int64 game_index,
+    OnMove on_move)
+{
+    SimulatorRng rng = make_game_rng(test_seed, game_index);
+    HiddenDungeon hidden = generate_dungeon(test_geometry, test_hazard_counts, rng);
+    RandomSafePolicy policy;
+
+    int32 position = hidden.m_start;
+    for (int32 move = 0; move < test_max_moves; move++)
+    {
+        dungeon.select_room(get_room_pos(position));
+
+        Attribute hazard = get_hazard(hidden, position);
+        if (hazard == a_Pit)
+        {
+            dungeon.found_a_pit();
+        }
+        else if (hazard != a__Count)
+        {
+            return move;
+        }
+        else
+        {
+            uint8 warnings = get_warnings(hidden, test_geometry, position);
+            dungeon.explore(warnings & 1, (warnings >> 1) & 1, (warnings >> 2) & 1);
+        }
+        on_move();
+
+        BoardMasks masks = dungeon.get_board_masks();
+        PolicyView view = make_policy_view(test_geometry, masks, position);
+        if (masks.m_room_state[a_Dragon][rs_Yes].any() || !view.m_frontier.any())
+            return move + 1;
+
+        position = policy.choose_room(view, rng);
+    }
+    return test_max_moves;
+}
+
+//////////////////////////////
+// Tests
+//////////////////////////////
+
+// Propagating from the rooms a move changed ends where sweeping the whole
+// board does, and where deriving every room from the observations does.
+void test_incremental_update(
+    const TestSettings& settings)
+{
+    for (int64 game = 0; game < test_games; game++)
+    {
+        auto dungeon = make_dungeon(settings);
+        play_game(*dungeon, game, [&]()
+        {
+            DungeonSnapshot incremental = dungeon->get_snapshot();
+            dungeon->update_room_states();
+            check(dungeon->get_snapshot() == incremental, settings.m_name, "incremental update differs from a full sweep", game);
+
+            if (is_order_free(settings))
+            {
+                dungeon->derive_room_states();
+                check(dungeon->get_snapshot() == incremental, settings.m_name, "incremental update differs from a full derivation", game);
+            }
+        });
+    }
+}
+
+// Retracting an observation leaves the board a board that never had it
+// would have, and entering it again puts back the board before.
+void test_retraction(
+    const TestSettings& settings)
+{
+    if (!is_order_free(settings))
+        return;
+
+    for (int64 game = 0; game < test_games; game++)
+    {
+        auto dungeon = make_dungeon(settings);
+        play_game(*dungeon, game, []() {});
+
+        SimulatorRng rng = make_game_rng(test_seed + 1, game);
+        for (int32 retraction = 0; retraction < 3; retraction++)
+        {
+            Bitboard visited = dungeon->get_board_masks().m_visited;
+            if (!visited.any())
+                break;
+
+            ivec2 room_pos = get_room_pos(pick_room(visited, rng));
+            Observation observation = dungeon->get_observation(room_pos);
+            DungeonSnapshot before = dungeon->get_snapshot();
+
+            dungeon->retract_observation(room_pos);
+
+            auto fresh = make_dungeon(settings);
+            for (int32 index = 0; index < test_geometry.room_count(); index++)
+            {
+                const Observation& entered = dungeon->get_observation(get_room_pos(index));
+                if (!(entered == Observation{}))
+                {
+                    fresh->edit_observation(get_room_pos(index), entered);
+                }
+            }
+            check(fresh->get_snapshot() == dungeon->get_snapshot(), settings.m_name, "retraction differs from entering the rest afresh", game);
+
+            dungeon->edit_observation(room_pos, observation);
+            check(dungeon->get_snapshot() == before, settings.m_name, "entering a retracted observation again differs", game);
+            dungeon->retract_observation(room_pos);
+        }
+    }
+}
+
+// Undoing every move gets back the empty board and redoing them all the
+// board at the end, through the same boards on the way.
+void test_undo_redo(
+    const TestSettings& settings)
+{
+    for (int64 game = 0; game < test_games; game++)
+    {
+        auto dungeon = make_dungeon(settings);
+        std::vector<DungeonSnapshot> snapshots{ dungeon->get_snapshot() };
+        play_game(*dungeon, game, [&]()
+        {
+            snapshots.push_back(dungeon->get_snapshot());
+        });
+
+        bool same = true;
+        for (size_t position = snapshots.size() - 1; position > 0; position--)
+        {
+            same &= dungeon->can_undo();
+            dungeon->undo();
+            same &= dungeon->get_snapshot() == snapshots[position - 1];
+        }
+        check(same && !dungeon->can_undo(), settings.m_name, "undoing every move differs from the boards played", game);
+        check(dungeon->get_snapshot() == make_dungeon(settings)->get_snapshot(), settings.m_name, "undoing every move does not give an empty board", game);
+
+        same = true;
+        for (size_t position = 1; position < snapshots.size(); position++)
+        {
+            same &= dungeon->can_redo();
+            dungeon->redo();
+            same &= dungeon->get_snapshot() == snapshots[position];
+        }
+        check(same && !dungeon->can_redo(), settings.m_name, "redoing every move differs from the boards played", game);
+    }
+}
+
+// A loaded session is the board saved, history included, and saves the
+// same bytes again.
+void test_session(
+    const TestSettings& settings)
+{
+    for (int64 game = 0; game < test_games; game++)
+    {
+        auto dungeon = make_dungeon(settings);
+        int32 moves = play_game(*dungeon, game, []() {});
+        for (int32 step = 0; step < moves / 2; step++)
+        {
+            dungeon->undo();
+        }
+
+        std::vector<uint8> session = dungeon->save_session();
+        auto loaded = std::make_unique<TestDungeon>(1);
+        loaded->set_headless(true);
+        check(loaded->load_session(session.data(), session.size()), settings.m_name, "session does not load", game);
+        check(loaded->get_snapshot() == dungeon->get_snapshot(), settings.m_name, "loaded session differs from the board saved", game);
+        check(loaded->save_session() == session, settings.m_name, "loaded session saves different bytes", game);
+
+        bool same = true;
+        while (dungeon->can_redo())
+        {
+            dungeon->redo();
+            same &= loaded->can_redo();
+            loaded->redo();
+            same &= loaded->get_snapshot() == dungeon->get_snapshot();
+        }
+        check(same && !loaded->can_redo(), settings.m_name, "loaded session redoes differently", game);
+    }
+}
+
+// Replays what the log took to the file onto a fresh board.
+DungeonSnapshot replay_log(
+    ObservationLog& log,
+    const std::filesystem::path& path,
+    int64& events)
+{
+    std::vector<uint8> bytes = log.take_pending();
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+    }
+
+    ObservationLogReader reader(path.string());
+    auto replayed = std::make_unique<TestDungeon>(1);
+    events = reader.is_valid() ? replayed->replay(reader) : -1;
+    return replayed->get_snapshot();
+}
+
+// A log replays to the board it was taken from, through moves, steps and
+// edits, and one started on a board already played replays to it too.
+void test_log(
+    const TestSettings& settings,
+    const std::filesystem::path& path)
+{
+    for (int64 game = 0; game < test_games; game++)
+    {
+        auto dungeon = make_dungeon(settings);
+        ObservationLog log;
+        log.begin(Torus::id, dungeon_size, dungeon_size);
+        dungeon->set_log(&log, true);
+
+        int32 moves = 0;
+        play_game(*dungeon, game, [&]()
+        {
+            if (++moves % 7 == 0)
+            {
+                dungeon->undo();
+                dungeon->undo();
+                dungeon->redo();
+            }
+            else if (moves % 11 == 0)
+            {
+                Observation observation;
+                observation.m_room_state[a_Arrow] = rs_No;
+                dungeon->edit_observation(get_room_pos(moves), observation);
+            }
+        });
+
+        int64 events = 0;
+        check(replay_log(log, path, events) == dungeon->get_snapshot() && events > 0, settings.m_name, "replayed log differs from the board", game);
+
+        std::vector<uint8> session = dungeon->save_session();
+        auto loaded = std::make_unique<TestDungeon>(1);
+        loaded->set_headless(true);
+        loaded->load_session(session.data(), session.size());
+
+        ObservationLog started;
+        started.begin(Torus::id, dungeon_size, dungeon_size);
+        loaded->set_log(&started, true);
+        check(replay_log(started, path, events) == loaded->get_snapshot() && events > 0, settings.m_name, "log started on a loaded board replays differently", game);
+    }
+}
+
+//////////////////////////////
+// Small boards
+//////////////////////////////
+
+// Observations from a few rooms of a random dungeon on a board small
+// enough to try every placement, sometimes with a warning read wrong.
+BoardMasks make_small_board(
+    const BoardGeometry& geometry,
+    SimulatorRng& rng)
+{
+    const int32 hazard_counts[a__Count]{ 3, 2, 1 };
+    HiddenDungeon hidden = generate_dungeon(geometry, hazard_counts, rng);
+
+    BoardMasks masks;
+    for (int32 a = 0; a < a__Count; a++)
+    {
+        masks.m_room_state[a][rs_Unknown] = geometry.all();
+        masks.m_neighbor_state[a][ns_Unknown] = geometry.all();
+        if (rng() % 2)
+        {
+            masks.m_hazard_count[a] = hazard_counts[a];
+        }
+    }
+
+    Bitboard empty = geometry.all() & ~(hidden.m_hazards[a_Pit] | hidden.m_hazards[a_Arrow] | hidden.m_hazards[a_Dragon]);
+    int32 visits = 1 + (int32)(rng() % empty.count());
+    for (int32 visit = 0; visit < visits; visit++)
+    {
+        int32 index = pick_room(empty, rng);
+        empty.reset(index);
+
+        Bitboard room;
+        room.set(index);
+        masks.m_visited |= room;
+
+        uint8 warnings = get_warnings(hidden, geometry, index);
+        if (rng() % 8 == 0)
+        {
+            warnings ^= (uint8)(1 << (rng() % a__Count));
+        }
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            move_to_state(masks.m_room_state[a], room, rs_No);
+            masks.m_neighbor_state[a][ns_Unknown] &= ~room;
+            masks.m_neighbor_state[a][(warnings >> a) & 1 ? ns_Yes : ns_No] |= room;
+        }
+    }
+
+    // A pit found by falling in.
+    Bitboard pits = hidden.m_hazards[a_Pit];
+    if (rng() % 2 && pits.any())
+    {
+        Bitboard room;
+        room.set(pick_room(pits, rng));
+        masks.m_visited |= room;
+        move_to_state(masks.m_room_state[a_Pit], room, rs_Yes);
+    }
+    return masks;
+}
+
+// Every placement of one attribute's hazards that agrees with the masks,
+// counted per room.
+struct BruteForceCount
+{
+    double m_total = 0.0;
+    double m_hits[bitboard_capacity]{};
+    uint32 m_always = ~0u;      // rooms with a hazard in every placement
+    uint32 m_ever = 0;          // rooms with a hazard in some placement
+};
+
+BruteForceCount count_placements(
+    const BoardGeometry& geometry,
+    const BoardMasks& masks,
+    const Attribute attrib)
+{
+    const int32 room_count = geometry.room_count();
+    auto to_bits = [&](const Bitboard& board)
+    {
+        uint32 bits = 0;
+        for (int32 index = 0; index < room_count; index++)
+        {
+            bits |= (uint32)board.test(index) << index;
+        }
+        return bits;
+    };
+
+    uint32 neighbors[bitboard_capacity]{};
+    for (int32 index = 0; index < room_count; index++)
+    {
+        for (int32 d = 0; d < geometry.direction_count(); d++)
+        {
+            int32 neighbor = geometry.get_neighbor(index, d);
+            if (neighbor != room_count)
+                neighbors[index] |= 1u << neighbor;
+        }
+    }
+
+    uint32 yes = to_bits(masks.m_room_state[attrib][rs_Yes]);
+    uint32 no = to_bits(masks.m_room_state[attrib][rs_No]);
+    uint32 warned = to_bits(masks.m_neighbor_state[attrib][ns_Yes]);
+    uint32 quiet = to_bits(masks.m_neighbor_state[attrib][ns_No]);
+    int32 count = get_hazard_count(masks, attrib);
+
+    BruteForceCount result;
+    for (uint32 placement = 0; placement < 1u << room_count; placement++)
+    {
+        if ((placement & yes) != yes || (placement & no) || (count >= 0 && std::popcount(placement) != count))
+            continue;
+
+        bool agrees = true;
+        for (int32 index = 0; index < room_count && agrees; index++)
+        {
+            if ((warned >> index) & 1)
+                agrees = (neighbors[index] & placement) != 0;
+            else if ((quiet >> index) & 1)
+                agrees = (neighbors[index] & placement) == 0;
+        }
+        if (!agrees)
+            continue;
+
+        result.m_total++;
+        result.m_always &= placement;
+        result.m_ever |= placement;
+        for (int32 index = 0; index < room_count; index++)
+        {
+            result.m_hits[index] += (placement >> index) & 1;
+        }
+    }
+    return result;
+}
+
+// After the local rules, as in Dungeon, the solver forces exactly the
+// rooms every placement agrees on, and the probabilities are the share
+// of placements with a hazard in the room.
+void test_small_boards(
+    const char* test_name,
+    const BoardGeometry& geometry,
+    const int32 boards)
+{
+    BitboardEngine bitboard_engine(geometry);
+    EntailmentSolver solver(geometry);
+    ProbabilityEngine probability_engine;
+    SimulatorRng rng(test_seed);
+
+    for (int64 board = 0; board < boards; board++)
+    {
+        BoardMasks masks = make_small_board(geometry, rng);
+        BoardMasks solved = masks;
+        bitboard_engine.update_room_states(solved);
+        SolverStats stats = solver.run(solved);
+
+        for (int32 a = 0; a < a__Count; a++)
+        {
+            Attribute attrib = (Attribute)a;
+            BruteForceCount brute_force = count_placements(geometry, masks, attrib);
+            bool consistent = brute_force.m_total > 0.0;
+
+            float probabilities[bitboard_capacity];
+            ProbabilityStats probability_stats;
+            bool counted = probability_engine.compute(solver.make_problem(masks, attrib), probabilities, probability_stats);
+            check(counted == consistent, test_name, "probabilities disagree on whether any placement fits", board);
+
+            if (stats.m_gave_up[attrib])
+                continue;
+
+            check(stats.m_consistent[attrib] == consistent, test_name, "solver disagrees on whether any placement fits", board);
+            if (!consistent)
+                continue;
+
+            bool same = true;
+            for (int32 index = 0; index < geometry.room_count(); index++)
+            {
+                bool always = (brute_force.m_always >> index) & 1;
+                bool never = !((brute_force.m_ever >> index) & 1);
+                same &= solved.m_room_state[attrib][rs_Yes].test(index) == always;
+                same &= solved.m_room_state[attrib][rs_No].test(index) == never;
+                same &= std::fabs(probabilities[index] - brute_force.m_hits[index] / brute_force.m_total) < 1e-4;
+            }
+            check(same, test_name, "forced rooms or probabilities differ from every placement tried", board);
+        }
+    }
+}
+
+//////////////////////////////
+// Main entry point
+//////////////////////////////
+
+int main()
+{
+    std::error_code error;
+    std::filesystem::path log_path = std::filesystem::temp_directory_path(error) / ("companion_test_" + std::to_string(std::random_device()()) + ".log");
+
+    for (const TestSettings& settings : test_settings)
+    {
+        test_incremental_update(settings);
+        test_retraction(settings);
+        test_undo_redo(settings);
+        test_session(settings);
+        test_log(settings, log_path);
+    }
+    std::filesystem::remove(log_path, error);
+
+    test_small_boards("walled 4x3", BoardGeometry(WalledGrid{}, 4, 3), 400);
+    test_small_boards("torus 4x4", BoardGeometry(Torus{}, 4, 4), 100);
+    test_small_boards("hex 4x4", BoardGeometry(HexGrid{}, 4, 4), 100);
+
+    if (test_failures)
+    {
+        printf("%d checks failed\n", test_failures);
+        return 1;
+    }
+
+    printf("all checks passed\n");
+    return 0;
+}